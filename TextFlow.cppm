@@ -0,0 +1,73 @@
+// TextFlowCpp
+//
+// A C++20 named module for TextFlow, so that importers don't need to parse the header
+// (and the standard headers it includes) at all:
+//
+//     import textflow;
+//
+// Compile this as a module interface unit with any TEXTFLOW_CONFIG_ macros you want,
+// e.g. g++ -std=c++20 -fmodules-ts -c -x c++ TextFlow.cppm
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+module;
+
+#include "TextFlow.hpp"
+
+export module textflow;
+
+export namespace TextFlow {
+    using TextFlow::isWhitespace;
+    using TextFlow::isBreakableBefore;
+    using TextFlow::isBreakableAfter;
+    using TextFlow::escapeSequenceLength;
+    using TextFlow::visibleLength;
+    using TextFlow::SgrState;
+    using TextFlow::updateSgrState;
+
+    using TextFlow::StringRef;
+    using TextFlow::Alignment;
+    using TextFlow::Column;
+    using TextFlow::FixedColumn;
+    using TextFlow::Spacer;
+    using TextFlow::Columns;
+    using TextFlow::Compaction;
+    using TextFlow::DiffRenderer;
+    using TextFlow::LineBreakIndex;
+    using TextFlow::TextPosition;
+    using TextFlow::LineMap;
+    using TextFlow::MultiWidthLayout;
+    using TextFlow::FileSink;
+
+#ifndef TEXTFLOW_CONFIG_DISABLE_IOSTREAMS
+    using TextFlow::operator<<;
+#endif
+
+#ifdef TEXTFLOW_CONFIG_ENABLE_STREAMING
+    using TextFlow::StreamColumn;
+#endif
+
+#ifdef TEXTFLOW_CONFIG_ENABLE_HYPHENATION
+    using TextFlow::Hyphenator;
+#endif
+
+#ifdef TEXTFLOW_CONFIG_ENABLE_POSIX_IO
+    using TextFlow::MappedFile;
+    using TextFlow::FdSink;
+#endif
+
+    using TextFlow::StaticString;
+    using TextFlow::wrapLiteral;
+
+#ifdef TEXTFLOW_CONFIG_ENABLE_COROUTINES
+    using TextFlow::Generator;
+    using TextFlow::generateLines;
+#ifdef TEXTFLOW_CONFIG_ENABLE_STREAMING
+    using TextFlow::readChunksFrom;
+#endif
+#ifdef TEXTFLOW_CONFIG_ENABLE_THREADS
+    using TextFlow::runAhead;
+#endif
+#endif
+}
@@ -11,104 +11,1346 @@
 #define TEXTFLOW_HPP_INCLUDED
 
 #include <cassert>
-#include <ostream>
-#include <sstream>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iosfwd>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+// The std::ostream operators are the only thing that need <ostream>. Without them
+// (e.g. in programs that never use iostreams) it can be left out, to include less
+#ifndef TEXTFLOW_CONFIG_DISABLE_IOSTREAMS
+#include <ostream>
+#endif
+
+// Everything else that needs more of the standard library is optional, so that
+// including the header stays cheap for code that only wraps text.
+// Define the same TEXTFLOW_CONFIG_ macros in every translation unit that includes it
+
+#ifdef TEXTFLOW_CONFIG_ENABLE_THREADS
+#include <atomic>
+#include <functional>
+#include <thread>
+#endif
+
+#ifdef TEXTFLOW_CONFIG_ENABLE_HYPHENATION
+#include <algorithm>
+#include <cerrno>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <unordered_map>
+#endif
+
+#ifdef TEXTFLOW_CONFIG_ENABLE_STREAMING
+#include <functional>
+#endif
+
+#ifdef TEXTFLOW_CONFIG_ENABLE_COROUTINES
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+#ifdef TEXTFLOW_CONFIG_ENABLE_THREADS
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#endif
+#endif
+
+#ifdef TEXTFLOW_CONFIG_ENABLE_POSIX_IO
+#include <cerrno>
+#include <climits>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
 #ifndef TEXTFLOW_CONFIG_CONSOLE_WIDTH
 #define TEXTFLOW_CONFIG_CONSOLE_WIDTH 80
 #endif
 
+// The wrapping itself is constexpr where the language allows loops in constant expressions
+#if __cplusplus >= 201402L || ( defined( _MSVC_LANG ) && _MSVC_LANG >= 201402L )
+#define TEXTFLOW_CONSTEXPR14 constexpr
+#else
+#define TEXTFLOW_CONSTEXPR14 inline
+#endif
+
 
 namespace TextFlow {
 
-    inline auto isWhitespace( char c ) -> bool {
-        static std::string chars = " \t\n\r";
-        return chars.find( c ) != std::string::npos;
+    constexpr auto isWhitespace( char c ) -> bool {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+    constexpr auto isBreakableBefore( char c ) -> bool {
+        return c == '[' || c == '(' || c == '{' || c == '<' || c == '|';
     }
-    inline auto isBreakableBefore( char c ) -> bool {
-        static std::string chars = "[({<|";
-        return chars.find( c ) != std::string::npos;
+    constexpr auto isBreakableAfter( char c ) -> bool {
+        return c == ']' || c == ')' || c == '}' || c == '>' || c == '.' || c == ',' || c == ':' ||
+               c == ';' || c == '*' || c == '+' || c == '-' || c == '=' || c == '&' || c == '/' || c == '\\';
+    }
+
+    // Refers to text held elsewhere, which must outlive it
+    class StringRef {
+        char const* m_data = nullptr;
+        size_t m_size = 0;
+
+    public:
+        constexpr StringRef() = default;
+        constexpr StringRef( char const* data, size_t size ) : m_data( data ), m_size( size ) {}
+        StringRef( std::string const& str ) : m_data( str.data() ), m_size( str.size() ) {}
+
+        constexpr auto data() const -> char const* { return m_data; }
+        constexpr auto size() const -> size_t { return m_size; }
+        constexpr auto empty() const -> bool { return m_size == 0; }
+        constexpr auto operator[]( size_t index ) const -> char { return m_data[index]; }
+
+        auto find( char c, size_t from ) const -> size_t {
+            if( from >= m_size )
+                return std::string::npos;
+            auto found = static_cast<char const*>( std::memchr( m_data + from, c, m_size - from ) );
+            return found ? static_cast<size_t>( found - m_data ) : std::string::npos;
+        }
+    };
+
+#ifdef TEXTFLOW_CONFIG_ENABLE_POSIX_IO
+    // A file mapped read-only into memory, so that a Column can wrap it straight from the
+    // page cache - e.g. Column( file.text() ) - with no copies into user space.
+    // Throws std::system_error if the file can't be opened or mapped
+    class MappedFile {
+        void* m_data = nullptr;
+        size_t m_size = 0;
+
+    public:
+        // `hugePages` asks the kernel to back the mapping with huge pages, where it can
+        explicit MappedFile( std::string const& path, bool hugePages = false ) {
+            int fd = ::open( path.c_str(), O_RDONLY );
+            if( fd < 0 )
+                throw std::system_error( errno, std::generic_category(), path );
+
+            struct stat info;
+            if( ::fstat( fd, &info ) != 0 ) {
+                auto error = errno;
+                ::close( fd );
+                throw std::system_error( error, std::generic_category(), path );
+            }
+            m_size = static_cast<size_t>( info.st_size );
+            if( m_size > 0 ) {
+                m_data = ::mmap( nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+                if( m_data == MAP_FAILED ) {
+                    auto error = errno;
+                    ::close( fd );
+                    throw std::system_error( error, std::generic_category(), path );
+                }
+                ::madvise( m_data, m_size, MADV_SEQUENTIAL );
+#ifdef MADV_HUGEPAGE
+                if( hugePages )
+                    ::madvise( m_data, m_size, MADV_HUGEPAGE );
+#else
+                (void)hugePages;
+#endif
+            }
+            ::close( fd );
+        }
+        MappedFile( MappedFile&& other ) noexcept : m_data( other.m_data ), m_size( other.m_size ) {
+            other.m_data = nullptr;
+            other.m_size = 0;
+        }
+        MappedFile( MappedFile const& ) = delete;
+        auto operator = ( MappedFile const& ) -> MappedFile& = delete;
+        ~MappedFile() {
+            if( m_data )
+                ::munmap( m_data, m_size );
+        }
+
+        auto text() const -> StringRef { return { static_cast<char const*>( m_data ), m_size }; }
+    };
+#endif // TEXTFLOW_CONFIG_ENABLE_POSIX_IO
+
+    // Returns the length, in bytes, of the ANSI escape sequence (CSI, OSC, or a
+    // plain two byte escape) starting at `at`, or 0 if there isn't one there.
+    // Unterminated sequences run to the end of the text.
+    TEXTFLOW_CONSTEXPR14 auto escapeSequenceLength( StringRef text, size_t at ) -> size_t {
+        if( at >= text.size() || text[at] != '\x1b' )
+            return 0;
+        if( at+1 == text.size() )
+            return 1;
+        size_t end = at+2;
+        switch( text[at+1] ) {
+            case '[': // CSI: parameter and intermediate bytes, then a final byte
+                while( end < text.size() && ( text[end] < 0x40 || text[end] > 0x7e ) )
+                    ++end;
+                return end < text.size() ? end+1-at : end-at;
+            case ']': // OSC: terminated by BEL or ST (ESC \)
+                while( end < text.size() && text[end] != '\a' ) {
+                    if( text[end] == '\x1b' && end+1 < text.size() && text[end+1] == '\\' )
+                        return end+2-at;
+                    ++end;
+                }
+                return end < text.size() ? end+1-at : end-at;
+            default:
+                return 2;
+        }
     }
-    inline auto isBreakableAfter( char c ) -> bool {
-        static std::string chars = "])}>.,:;*+-=&/\\";
-        return chars.find( c ) != std::string::npos;
+
+    inline auto visibleLength( StringRef text, size_t from = 0 ) -> size_t {
+        size_t len = 0;
+        for( size_t at = from; at < text.size(); ) {
+            if( auto escLen = escapeSequenceLength( text, at ) )
+                at += escLen;
+            else {
+                ++at;
+                ++len;
+            }
+        }
+        return len;
     }
 
+    // The rendition (colours and styles) set by SGR sequences, kept as one setting per attribute -
+    // so later codes replace or clear earlier ones rather than piling up. Codes it doesn't know are dropped.
+    // It's a few bytes of plain data, so iterators can carry it around (and copy it) without allocating
+    class SgrState {
+        enum Group { Bold, Faint, Italic, Underline, Blink, Inverse, Conceal, Strike, Font, Overline, GroupCount };
+        enum ColourGroup { Foreground, Background, UnderlineColour, ColourGroupCount };
+        enum ColourKind : std::uint8_t { NoColour, Basic, Indexed, Rgb };
+
+        struct Colour {
+            std::uint8_t kind; // a ColourKind
+            std::uint8_t values[3]; // the code, for a basic colour, the palette index, or the RGB components
+        };
+
+        std::uint8_t m_codes[GroupCount] = {}; // the code that set each attribute, or 0 if it's not set
+        std::uint8_t m_underlineStyle = 0; // the style sub-parameter of 4 (as in 4:3), plus one, if it had one
+        Colour m_colours[ColourGroupCount] = {};
+
+        static auto groupOf( size_t code ) -> Group {
+            if( code == 1 ) return Bold;
+            if( code == 2 ) return Faint;
+            if( code == 3 ) return Italic;
+            if( code == 4 || code == 21 ) return Underline;
+            if( code == 5 || code == 6 ) return Blink;
+            if( code == 7 ) return Inverse;
+            if( code == 8 ) return Conceal;
+            if( code == 9 ) return Strike;
+            if( code >= 11 && code <= 19 ) return Font;
+            if( code == 53 ) return Overline;
+            return GroupCount;
+        }
+        static auto colourGroupOf( size_t code ) -> ColourGroup {
+            if( ( code >= 30 && code <= 38 ) || ( code >= 90 && code <= 97 ) ) return Foreground;
+            if( ( code >= 40 && code <= 48 ) || ( code >= 100 && code <= 107 ) ) return Background;
+            if( code == 58 ) return UnderlineColour;
+            return ColourGroupCount;
+        }
+        // The code's first group to clear, and how many after it, if it's a reset
+        static auto clearsOf( size_t code ) -> std::pair<Group, size_t> {
+            switch( code ) {
+                case 10: return { Font, 1 };
+                case 22: return { Bold, 2 };
+                case 23: return { Italic, 1 };
+                case 24: return { Underline, 1 };
+                case 25: return { Blink, 1 };
+                case 27: return { Inverse, 1 };
+                case 28: return { Conceal, 1 };
+                case 29: return { Strike, 1 };
+                case 55: return { Overline, 1 };
+                default: return { GroupCount, 0 };
+            }
+        }
+        static auto colourClearsOf( size_t code ) -> ColourGroup {
+            return code == 39 ? Foreground : code == 49 ? Background : code == 59 ? UnderlineColour : ColourGroupCount;
+        }
+
+        // Reads the (sub-)parameter at `at`, leaving `at` at the separator after it.
+        // An empty one is 0, and one that isn't a number (or is too big to be one we use) is npos
+        static auto readNumber( StringRef params, size_t& at ) -> size_t {
+            size_t value = 0;
+            for(; at < params.size() && params[at] != ';' && params[at] != ':'; ++at )
+                value = params[at] >= '0' && params[at] <= '9' && value < 1000 ? value*10 + static_cast<size_t>( params[at] - '0' ) : std::string::npos;
+            return value;
+        }
+
+        // Sets an extended colour from what follows 38, 48 or 58: 5;n (or 5:n) or 2;r;g;b (or 2:r:g:b, or 2:cs:r:g:b)
+        void setExtended( ColourGroup group, size_t const* args, size_t count ) {
+            Colour colour{ NoColour, { 0, 0, 0 } };
+            if( count >= 2 && args[0] == 5 && args[1] <= 255 )
+                colour = Colour{ Indexed, { static_cast<std::uint8_t>( args[1] ), 0, 0 } };
+            else if( count >= 4 && args[0] == 2 && args[count-3] <= 255 && args[count-2] <= 255 && args[count-1] <= 255 )
+                colour = Colour{ Rgb, { static_cast<std::uint8_t>( args[count-3] ), static_cast<std::uint8_t>( args[count-2] ), static_cast<std::uint8_t>( args[count-1] ) } };
+            if( colour.kind != NoColour )
+                m_colours[group] = colour;
+        }
+
+        static void appendNumber( std::string& out, size_t value ) {
+            char digits[4];
+            size_t count = 0;
+            do {
+                digits[count++] = static_cast<char>( '0' + value % 10 );
+                value /= 10;
+            } while( value > 0 );
+            while( count > 0 )
+                out += digits[--count];
+        }
+
+    public:
+        // Applies the parameters of an SGR sequence (what's between the "ESC [" and the "m")
+        void apply( StringRef params ) {
+            for( size_t at = 0; at <= params.size(); ++at ) {
+                auto code = readNumber( params, at );
+
+                // Sub-parameters follow colons (38:5:n). 38, 48 and 58 may instead take the colour from the parameters after them
+                size_t args[6];
+                size_t count = 0;
+                bool hasSubParameters = at < params.size() && params[at] == ':';
+                while( at < params.size() && params[at] == ':' ) {
+                    ++at;
+                    auto arg = readNumber( params, at );
+                    if( count < 6 )
+                        args[count++] = arg;
+                }
+                if( ( code == 38 || code == 48 || code == 58 ) && !hasSubParameters && at < params.size() ) {
+                    ++at;
+                    args[count++] = readNumber( params, at );
+                    for( auto more = args[0] == 5 ? 1 : args[0] == 2 ? 3 : 0; more > 0 && at < params.size(); --more ) {
+                        ++at;
+                        args[count++] = readNumber( params, at );
+                    }
+                }
+
+                if( code == 0 )
+                    clear();
+                else if( groupOf( code ) != GroupCount ) {
+                    auto group = groupOf( code );
+                    if( code == 4 && hasSubParameters && count > 0 && args[0] == 0 ) // 4:0 is no underline
+                        m_codes[group] = 0;
+                    else {
+                        m_codes[group] = static_cast<std::uint8_t>( code );
+                        if( group == Underline )
+                            m_underlineStyle = code == 4 && hasSubParameters && count > 0 && args[0] <= 5 ? static_cast<std::uint8_t>( args[0]+1 ) : 0;
+                    }
+                }
+                else if( code == 38 || code == 48 || code == 58 )
+                    setExtended( colourGroupOf( code ), args, count );
+                else if( colourGroupOf( code ) != ColourGroupCount )
+                    m_colours[colourGroupOf( code )] = Colour{ Basic, { static_cast<std::uint8_t>( code ), 0, 0 } };
+                else if( colourClearsOf( code ) != ColourGroupCount )
+                    m_colours[colourClearsOf( code )] = Colour{ NoColour, { 0, 0, 0 } };
+                else {
+                    auto clears = clearsOf( code );
+                    for( size_t i = 0; i < clears.second; ++i )
+                        m_codes[clears.first+i] = 0;
+                }
+            }
+        }
+
+        void clear() { *this = SgrState(); }
+        auto empty() const -> bool {
+            for( auto code : m_codes )
+                if( code != 0 )
+                    return false;
+            for( auto const& colour : m_colours )
+                if( colour.kind != NoColour )
+                    return false;
+            return true;
+        }
+
+        // Appends a single SGR sequence that re-establishes the rendition, or nothing if there's none
+        void appendTo( std::string& out ) const {
+            bool first = true;
+            auto separate = [&] {
+                out += first ? "\x1b[" : ";";
+                first = false;
+            };
+            for( size_t group = 0; group < GroupCount; ++group ) {
+                if( m_codes[group] == 0 )
+                    continue;
+                separate();
+                appendNumber( out, m_codes[group] );
+                if( group == Underline && m_underlineStyle != 0 ) {
+                    out += ':';
+                    appendNumber( out, m_underlineStyle-1u );
+                }
+            }
+            static constexpr std::uint8_t extendedCodes[ColourGroupCount] = { 38, 48, 58 };
+            for( size_t group = 0; group < ColourGroupCount; ++group ) {
+                auto const& colour = m_colours[group];
+                if( colour.kind == NoColour )
+                    continue;
+                separate();
+                if( colour.kind == Basic ) {
+                    appendNumber( out, colour.values[0] );
+                    continue;
+                }
+                appendNumber( out, extendedCodes[group] );
+                out += colour.kind == Indexed ? ";5" : ";2";
+                for( size_t i = 0; i < ( colour.kind == Indexed ? 1u : 3u ); ++i ) {
+                    out += ';';
+                    appendNumber( out, colour.values[i] );
+                }
+            }
+            if( !first )
+                out += 'm';
+        }
+        auto str() const -> std::string {
+            std::string out;
+            appendTo( out );
+            return out;
+        }
+    };
+
+    // Folds any SGR (colour/style) sequences in text[from, to) into `state`. Only that part of the
+    // text is searched, as this is called for every line
+    inline void updateSgrState( SgrState& state, StringRef text, size_t from, size_t to ) {
+        while( from < to ) {
+            auto found = static_cast<char const*>( std::memchr( text.data()+from, '\x1b', to-from ) );
+            if( !found )
+                return;
+            from = static_cast<size_t>( found - text.data() );
+            auto len = escapeSequenceLength( text, from );
+            if( len >= 3 && text[from+1] == '[' && text[from+len-1] == 'm' )
+                state.apply( StringRef( text.data()+from+2, len-3 ) );
+            from += len;
+        }
+    }
+
+    namespace Detail {
+        // Stand-ins for the little of <algorithm> that's needed, so that it doesn't have to be included
+        template<typename T>
+        constexpr auto minOf( T a, T b ) -> T { return b < a ? b : a; }
+        template<typename T>
+        constexpr auto maxOf( T a, T b ) -> T { return a < b ? b : a; }
+
+        // The first element of [first, last) that isn't `before( element )`, where all those that are come first
+        template<typename It, typename Before>
+        auto partitionPoint( It first, It last, Before before ) -> It {
+            for( auto count = last - first; count > 0; ) {
+                auto half = count / 2;
+                if( before( first[half] ) ) {
+                    first += half+1;
+                    count -= half+1;
+                }
+                else
+                    count = half;
+            }
+            return first;
+        }
+        // As std::upper_bound, on a sorted range
+        template<typename It, typename T>
+        auto upperBound( It first, It last, T const& value ) -> It {
+            return partitionPoint( first, last, [&]( T const& element ) { return !( value < element ); } );
+        }
+
+        // Letters (bytes) that can be part of a hyphenated word
+        constexpr auto isWordLetter( char c ) -> bool {
+            return ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) || static_cast<unsigned char>( c ) >= 0x80;
+        }
+        // As in TeX, longer words aren't hyphenated (so a huge one isn't scanned again for every line)
+        constexpr size_t maxHyphenatedWord = 63;
+
+        // Columns taken by a tab at `col`, with tab stops relative to the indent
+        constexpr auto tabSize( size_t tabWidth, size_t col ) -> size_t {
+            return tabWidth == 0 ? 1 : tabWidth - col % tabWidth;
+        }
+        // Appends `count` blank columns - as a cursor forward (CSI n C) sequence, if `cursorForward` and that's shorter
+        inline void appendBlank( std::string& out, size_t count, bool cursorForward ) {
+            if( cursorForward && count > 4 ) {
+                auto sequence = "\x1b[" + std::to_string( count ) + "C";
+                if( sequence.size() < count ) {
+                    out += sequence;
+                    return;
+                }
+            }
+            out.append( count, ' ' );
+        }
+        // Whether a tab at the start of a line with `width` columns is too wide to leave room for anything else
+        constexpr auto tabFillsLine( size_t tabWidth, size_t width ) -> bool {
+            return tabWidth != 0 && tabWidth >= width;
+        }
+        // Columns taken by a tab at `col` on a line with `width` columns. One that's too wide for the line
+        // is clamped to fill it, on a line of its own (as lines hold up to width-1 columns)
+        constexpr auto tabSize( size_t tabWidth, size_t col, size_t width ) -> size_t {
+            return col == 0 && tabFillsLine( tabWidth, width ) ? ( width > 1 ? width-1 : 1 ) : tabSize( tabWidth, col );
+        }
+
+        // In ANSI mode escape sequences are zero width, so are skipped over
+        TEXTFLOW_CONSTEXPR14 auto skipEscapes( StringRef text, size_t at, bool ansi ) -> size_t {
+            if( ansi )
+                while( auto len = escapeSequenceLength( text, at ) )
+                    at += len;
+            return at;
+        }
+
+        struct LineExtent {
+            size_t len;
+            bool suffix; // the line was split mid-word, so needs a hyphen
+        };
+
+        // Finds the extent of the line starting at `pos` in a single pass, tracking the
+        // last boundary (and the trimmed end of the text before it) that fits in the width.
+        // The width may be a std::integral_constant, so that the search is specialised for it
+        template<typename Width>
+        TEXTFLOW_CONSTEXPR14 auto findLineExtent( StringRef text, size_t pos, Width width, bool ansi, size_t tabWidth ) -> LineExtent {
+            size_t cols = 0;
+            size_t at = skipEscapes( text, pos, ansi );
+            size_t lastNonWsEnd = pos;
+            size_t bestEnd = pos;
+            size_t forcedEnd = at;
+            char prev = '\0';
+
+            for(;;) {
+                bool atEnd = at == text.size();
+                if( cols > 0 ) {
+                    if( atEnd ||
+                            ( isWhitespace( text[at] ) && !isWhitespace( prev ) ) ||
+                            isBreakableBefore( text[at] ) ||
+                            isBreakableAfter( prev ) )
+                        bestEnd = lastNonWsEnd;
+                    if( ( atEnd || text[at] == '\n' ) && cols < width )
+                        return { at - pos, false };
+                }
+                else if( atEnd ) {
+                    return { at - pos, false };
+                }
+                if( cols == 0 && text[at] == '\t' && tabFillsLine( tabWidth, width ) )
+                    return { at+1 - pos, false };
+                auto charWidth = text[at] == '\t' ? tabSize( tabWidth, cols ) : 1;
+                if( cols + charWidth > width )
+                    break;
+
+                prev = text[at++];
+                cols += charWidth;
+                if( cols < width )
+                    forcedEnd = at;
+                if( !isWhitespace( prev ) )
+                    lastNonWsEnd = at;
+
+                auto next = skipEscapes( text, at, ansi );
+                if( lastNonWsEnd == at )
+                    lastNonWsEnd = next; // keep escapes attached to the preceding text
+                at = next;
+            }
+
+            if( bestEnd > pos )
+                return { bestEnd - pos, false };
+            return { forcedEnd - pos, true };
+        }
+
+        // Where the line after one ending at `end` starts - past the newline or whitespace we wrapped at
+        TEXTFLOW_CONSTEXPR14 auto nextLineStart( StringRef text, size_t end, bool ansi ) -> size_t {
+            if( end < text.size() && text[end] == '\n' )
+                return end+1;
+            while( end < text.size() && isWhitespace( text[end] ) )
+                end = skipEscapes( text, end+1, ansi );
+            return end;
+        }
+
+        // Wraps plain text just as a single line Column with the same settings would, appending the result to
+        // `out` - which only needs std::string's append( count, char ) and append( chars, length )
+        template<typename Out>
+        TEXTFLOW_CONSTEXPR14 void wrapTo( StringRef text, size_t width, size_t indent, size_t initialIndent, Out& out ) {
+            for( size_t pos = 0; pos < text.size(); ) {
+                auto lineIndent = pos == 0 && initialIndent != std::string::npos ? initialIndent : indent;
+                auto extent = findLineExtent( text, pos, width-lineIndent, false, 0 );
+                if( pos > 0 )
+                    out.append( 1, '\n' );
+                out.append( lineIndent, ' ' );
+                out.append( text.data()+pos, extent.len );
+                if( extent.suffix )
+                    out.append( 1, '-' );
+                pos = nextLineStart( text, pos+extent.len, false );
+            }
+        }
+
+        // A fixed capacity array that holds up to N elements inline, only going
+        // to the heap for more. Elements are constructed in place by push_back
+        template<typename T, size_t N>
+        class SmallVector {
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type m_inline[N];
+            T* m_data;
+            size_t m_size = 0;
+
+        public:
+            explicit SmallVector( size_t capacity )
+            :   m_data( capacity <= N
+                            ? reinterpret_cast<T*>( m_inline )
+                            : static_cast<T*>( ::operator new( capacity * sizeof(T) ) ) )
+            {}
+            SmallVector( SmallVector const& other ) : SmallVector( other.m_size ) {
+                for( size_t i = 0; i < other.m_size; ++i )
+                    push_back( other[i] );
+            }
+            auto operator = ( SmallVector const& ) -> SmallVector& = delete;
+            ~SmallVector() {
+                for( size_t i = 0; i < m_size; ++i )
+                    m_data[i].~T();
+                if( m_data != reinterpret_cast<T*>( m_inline ) )
+                    ::operator delete( m_data );
+            }
+
+            void push_back( T const& value ) { new( m_data + m_size++ ) T( value ); }
+
+            auto size() const -> size_t { return m_size; }
+            auto operator[]( size_t index ) -> T& { return m_data[index]; }
+            auto operator[]( size_t index ) const -> T const& { return m_data[index]; }
+        };
+    } // namespace Detail
+
+    class Hyphenator;
+
+    namespace Detail {
+        // A hyphenator's breaks(), called through a pointer so that Column only
+        // needs Hyphenator (and the headers it includes) when hyphenation is enabled
+        using HyphenBreaks = std::vector<size_t> (*)( Hyphenator const&, StringRef );
+
+        // The text a column wraps: strings that refer either to text held elsewhere, or to a copy
+        // of its own - which is copied along with it
+        class ColumnText {
+            std::string m_owned;
+            std::vector<StringRef> m_strings;
+            bool m_isOwned = false;
+
+            void refer() {
+                if( m_isOwned )
+                    m_strings[0] = StringRef( m_owned );
+            }
+
+        public:
+            explicit ColumnText( std::string const& text ) : m_owned( text ), m_strings( 1 ), m_isOwned( true ) { refer(); }
+            explicit ColumnText( StringRef text ) : m_strings( 1, text ) {}
+            ColumnText( ColumnText const& other )
+            :   m_owned( other.m_owned ),
+                m_strings( other.m_strings ),
+                m_isOwned( other.m_isOwned )
+            {
+                refer();
+            }
+            ColumnText( ColumnText&& other ) noexcept
+            :   m_owned( std::move( other.m_owned ) ),
+                m_strings( std::move( other.m_strings ) ),
+                m_isOwned( other.m_isOwned )
+            {
+                refer();
+            }
+            auto operator = ( ColumnText other ) -> ColumnText& {
+                m_owned.swap( other.m_owned );
+                m_strings.swap( other.m_strings );
+                m_isOwned = other.m_isOwned;
+                refer();
+                return *this;
+            }
+
+            auto size() const -> size_t { return m_strings.size(); }
+            auto operator[]( size_t index ) -> StringRef& { return m_strings[index]; }
+            auto operator[]( size_t index ) const -> StringRef { return m_strings[index]; }
+            auto front() const -> StringRef { return m_strings.front(); }
+            auto begin() const -> std::vector<StringRef>::const_iterator { return m_strings.begin(); }
+            auto end() const -> std::vector<StringRef>::const_iterator { return m_strings.end(); }
+        };
+
+        // The pieces of some rendered lines, ready to be written out together. Pieces either refer
+        // to text held elsewhere - the text being wrapped, or shared runs of spaces - or to text
+        // that had to be generated (such as expanded tabs), which is kept in a scratch buffer
+        class SliceBuffer {
+            struct Slice {
+                char const* data; // null for text in the scratch buffer
+                size_t offset;
+                size_t size;
+            };
+            std::vector<Slice> m_slices;
+            std::string m_scratch;
+
+        public:
+            void append( StringRef text ) {
+                if( !text.empty() )
+                    m_slices.push_back( { text.data(), 0, text.size() } );
+            }
+            // Only runs of spaces are supported
+            void append( size_t count, char c ) {
+                assert( c == ' ' );
+                (void)c;
+                static const std::string spaces( 256, ' ' );
+                for(; count > spaces.size(); count -= spaces.size() )
+                    append( spaces );
+                append( StringRef( spaces.data(), count ) );
+            }
+
+            // Drops any of `chars` from the end of what was appended after the first `from` slices,
+            // returning how many were dropped
+            auto trimTrailing( size_t from, char const* chars ) -> size_t {
+                size_t trimmed = 0;
+                while( m_slices.size() > from ) {
+                    auto& slice = m_slices.back();
+                    auto data = slice.data ? slice.data : m_scratch.data() + slice.offset;
+                    for(; slice.size > 0 && std::strchr( chars, data[slice.size-1] ); --slice.size )
+                        ++trimmed;
+                    if( slice.size > 0 )
+                        break;
+                    m_slices.pop_back();
+                }
+                return trimmed;
+            }
+
+            auto scratch() -> std::string& { return m_scratch; }
+            // Adds whatever has been written to the scratch buffer since `from`
+            void appendScratch( size_t from ) {
+                if( from < m_scratch.size() )
+                    m_slices.push_back( { nullptr, from, m_scratch.size() - from } );
+            }
+
+            auto size() const -> size_t { return m_slices.size(); }
+
+            // Calls `f` with the data and size of each piece, in order
+            template<typename F>
+            void forEach( F&& f ) const {
+                for( auto const& slice : m_slices )
+                    f( slice.data ? slice.data : m_scratch.data() + slice.offset, slice.size );
+            }
+            void clear() {
+                m_slices.clear();
+                m_scratch.clear();
+            }
+        };
+
+        // Something derived from an object's (immutable) contents, built the first time it's needed.
+        // With TEXTFLOW_CONFIG_ENABLE_THREADS, if several threads need it at once they may each build it,
+        // but only one is published (with release semantics), and all of them then use that one
+        template<typename T>
+        class OnceCache {
+#ifdef TEXTFLOW_CONFIG_ENABLE_THREADS
+            mutable std::atomic<T const*> m_value{ nullptr };
+
+            auto current() const -> T const* { return m_value.load( std::memory_order_acquire ); }
+            auto replace( T const* value ) -> T const* { return m_value.exchange( value ); }
+            // Publishes `built` unless another thread got there first, returning whichever was published
+            auto publish( T const* built ) const -> T const* {
+                T const* published = nullptr;
+                if( m_value.compare_exchange_strong( published, built, std::memory_order_acq_rel, std::memory_order_acquire ) )
+                    return built;
+                return published;
+            }
+#else
+            // Without threads, there's nothing to race
+            mutable T const* m_value = nullptr;
+
+            auto current() const -> T const* { return m_value; }
+            auto replace( T const* value ) -> T const* {
+                auto old = m_value;
+                m_value = value;
+                return old;
+            }
+            auto publish( T const* built ) const -> T const* { return m_value = built; }
+#endif
+
+        public:
+            OnceCache() = default;
+            OnceCache( OnceCache const& ) {} // copies build their own, as the original may change
+            OnceCache( OnceCache&& other ) noexcept { replace( other.replace( nullptr ) ); }
+            auto operator=( OnceCache const& ) -> OnceCache& {
+                reset();
+                return *this;
+            }
+            auto operator=( OnceCache&& other ) noexcept -> OnceCache& {
+                delete replace( other.replace( nullptr ) );
+                return *this;
+            }
+            ~OnceCache() { delete current(); }
+
+            template<typename Build>
+            auto get( Build build ) const -> T const& {
+                if( auto value = current() )
+                    return *value;
+                auto built = new T( build() );
+                auto published = publish( built );
+                if( published != built )
+                    delete built;
+                return *published;
+            }
+
+            // Not safe to call while other threads may be reading
+            void reset() { delete replace( nullptr ); }
+        };
+
+        // The places a string may be broken when it's wrapped, ignoring the width
+        struct StringBreaks {
+            std::vector<size_t> boundaries; // positions a line may end at
+            std::vector<size_t> trimmed;    // where the text before each boundary ends, less any whitespace
+            std::vector<size_t> newlines;
+
+            explicit StringBreaks( StringRef text ) {
+                size_t lastNonWsEnd = 0;
+                for( size_t at = 1; at <= text.size(); ++at ) {
+                    char prev = text[at-1];
+                    if( !isWhitespace( prev ) )
+                        lastNonWsEnd = at;
+                    if( prev == '\n' )
+                        newlines.push_back( at-1 );
+                    if( at == text.size() ||
+                            ( isWhitespace( text[at] ) && !isWhitespace( prev ) ) ||
+                            isBreakableBefore( text[at] ) ||
+                            isBreakableAfter( prev ) ) {
+                        boundaries.push_back( at );
+                        trimmed.push_back( lastNonWsEnd );
+                    }
+                }
+            }
+        };
+
+        // 64 bit FNV-1a, for spotting changes cheaply
+        class Fnv1a {
+            uint64_t m_hash = 14695981039346656037ull;
+
+        public:
+            void add( char const* data, size_t size ) {
+                for( size_t i = 0; i < size; ++i ) {
+                    m_hash ^= static_cast<unsigned char>( data[i] );
+                    m_hash *= 1099511628211ull;
+                }
+            }
+            void add( size_t value ) { add( reinterpret_cast<char const*>( &value ), sizeof( value ) ); }
+            auto value() const -> uint64_t { return m_hash; }
+        };
+
+        template<typename Sink>
+        class SliceSink;
+    } // namespace Detail
+
+#ifdef TEXTFLOW_CONFIG_ENABLE_HYPHENATION
+    // Finds where words may be hyphenated, using Liang's algorithm (as TeX does) with a set of
+    // patterns, such as those from the TeX hyphenation project (e.g. hyph-en-us.pat.txt).
+    // The patterns are compiled into a packed trie, and results are cached per word.
+    // Can be shared between threads
+    class Hyphenator {
+        // The trie: node n's edges are [m_firstEdge[n], m_firstEdge[n+1]), sorted by their letters
+        std::vector<uint32_t> m_firstEdge;
+        std::vector<char> m_edgeLetters;
+        std::vector<uint32_t> m_edgeTargets;
+        // Where each node's pattern values start in m_values (as a count, then the values), or 0 for none
+        std::vector<uint32_t> m_nodeValues;
+        std::vector<uint8_t> m_values;
+        size_t m_leftMin;
+        size_t m_rightMin;
+
+        struct Cache {
+            std::mutex mutex;
+            std::unordered_map<std::string, std::vector<size_t>> words;
+        };
+        std::unique_ptr<Cache> m_cache{ new Cache };
+
+        static auto lower( char c ) -> char {
+            return c >= 'A' && c <= 'Z' ? static_cast<char>( c - 'A' + 'a' ) : c;
+        }
+
+        auto child( uint32_t node, char letter ) const -> uint32_t {
+            auto first = m_edgeLetters.begin() + m_firstEdge[node];
+            auto last = m_edgeLetters.begin() + m_firstEdge[node+1];
+            auto edge = std::lower_bound( first, last, letter );
+            if( edge == last || *edge != letter )
+                return 0; // the root is never a child
+            return m_edgeTargets[static_cast<size_t>( edge - m_edgeLetters.begin() )];
+        }
+
+        auto findBreaks( std::string const& word ) const -> std::vector<size_t> {
+            std::vector<size_t> breaks;
+            if( word.size() < m_leftMin + m_rightMin )
+                return breaks;
+
+            auto dotted = "." + word + ".";
+            std::vector<uint8_t> points( dotted.size()+1, 0 );
+            for( size_t start = 0; start < dotted.size(); ++start ) {
+                uint32_t node = 0;
+                for( size_t at = start; at < dotted.size(); ++at ) {
+                    node = child( node, dotted[at] );
+                    if( node == 0 )
+                        break;
+                    if( auto values = m_nodeValues[node] ) {
+                        for( size_t i = 0; i < m_values[values]; ++i )
+                            points[start+i] = (std::max)( points[start+i], m_values[values+1+i] );
+                    }
+                }
+            }
+            // An odd value between two letters allows a break there
+            for( size_t letters = m_leftMin; letters + m_rightMin <= word.size(); ++letters )
+                if( points[letters+1] % 2 == 1 )
+                    breaks.push_back( letters );
+            return breaks;
+        }
+
+    public:
+        // Letters (bytes) that can be part of a hyphenated word
+        static auto isLetter( char c ) -> bool { return Detail::isWordLetter( c ); }
+
+        // `patterns` are separated by whitespace, and a % starts a comment to the end of the line.
+        // Words are never broken within `leftMin` letters of their start or `rightMin` of their end
+        explicit Hyphenator( std::string const& patterns, size_t leftMin = 2, size_t rightMin = 3 )
+        :   m_leftMin( (std::max)( leftMin, size_t( 1 ) ) ),
+            m_rightMin( (std::max)( rightMin, size_t( 1 ) ) )
+        {
+            // Build the trie with a list of edges per node, then pack them all together
+            std::vector<std::vector<std::pair<char, uint32_t>>> children( 1 );
+            m_nodeValues.push_back( 0 );
+            m_values.push_back( 0 ); // so that offset 0 can mean no values
+
+            for( size_t at = 0; at < patterns.size(); ) {
+                if( patterns[at] == '%' ) {
+                    while( at < patterns.size() && patterns[at] != '\n' )
+                        ++at;
+                    continue;
+                }
+                if( isWhitespace( patterns[at] ) ) {
+                    ++at;
+                    continue;
+                }
+                uint32_t node = 0;
+                std::vector<uint8_t> values( 1, 0 );
+                for(; at < patterns.size() && !isWhitespace( patterns[at] ) && patterns[at] != '%'; ++at ) {
+                    char c = patterns[at];
+                    if( c >= '0' && c <= '9' ) {
+                        values.back() = static_cast<uint8_t>( c - '0' );
+                        continue;
+                    }
+                    c = lower( c );
+                    auto& edges = children[node];
+                    auto edge = std::find_if( edges.begin(), edges.end(), [c]( std::pair<char, uint32_t> const& e ) { return e.first == c; } );
+                    if( edge == edges.end() ) {
+                        auto next = static_cast<uint32_t>( children.size() );
+                        edges.push_back( { c, next } );
+                        children.emplace_back();
+                        m_nodeValues.push_back( 0 );
+                        node = next;
+                    }
+                    else
+                        node = edge->second;
+                    values.push_back( 0 );
+                }
+                if( node != 0 ) {
+                    m_nodeValues[node] = static_cast<uint32_t>( m_values.size() );
+                    m_values.push_back( static_cast<uint8_t>( values.size() ) );
+                    m_values.insert( m_values.end(), values.begin(), values.end() );
+                }
+            }
+
+            for( auto& edges : children ) {
+                std::sort( edges.begin(), edges.end() );
+                m_firstEdge.push_back( static_cast<uint32_t>( m_edgeLetters.size() ) );
+                for( auto const& edge : edges ) {
+                    m_edgeLetters.push_back( edge.first );
+                    m_edgeTargets.push_back( edge.second );
+                }
+            }
+            m_firstEdge.push_back( static_cast<uint32_t>( m_edgeLetters.size() ) );
+        }
+
+        // Loads the patterns from a file. Throws std::system_error if it can't be read
+        static auto fromFile( std::string const& path, size_t leftMin = 2, size_t rightMin = 3 ) -> Hyphenator {
+            auto file = std::fopen( path.c_str(), "rb" );
+            if( !file )
+                throw std::system_error( errno, std::generic_category(), path );
+            std::string patterns;
+            char buffer[4096];
+            while( auto read = std::fread( buffer, 1, sizeof( buffer ), file ) )
+                patterns.append( buffer, read );
+            bool failed = std::ferror( file ) != 0;
+            std::fclose( file );
+            if( failed )
+                throw std::system_error( EIO, std::generic_category(), path );
+            return Hyphenator( patterns, leftMin, rightMin );
+        }
+
+        // Where `word` may be hyphenated, as the number of letters before each break, in order.
+        // Words longer than 63 letters aren't hyphenated at all
+        auto breaks( StringRef word ) const -> std::vector<size_t> {
+            if( word.size() > Detail::maxHyphenatedWord )
+                return {};
+            std::string key( word.size(), '\0' );
+            for( size_t i = 0; i < word.size(); ++i )
+                key[i] = lower( word[i] );
+
+            std::lock_guard<std::mutex> lock( m_cache->mutex );
+            auto cached = m_cache->words.find( key );
+            if( cached != m_cache->words.end() )
+                return cached->second;
+            if( m_cache->words.size() >= 4096 )
+                m_cache->words.clear(); // keep the cache bounded on text with a large vocabulary
+            auto breaks = findBreaks( key );
+            m_cache->words.emplace( std::move( key ), breaks );
+            return breaks;
+        }
+    };
+#endif // TEXTFLOW_CONFIG_ENABLE_HYPHENATION
+
+    // Where each line goes within a column's width. Justified lines have their extra space spread
+    // between their words, except at the end of a paragraph (which is left aligned)
+    enum class Alignment { Left, Right, Centre, Justify };
+
+    // How Columns cuts down the blank space it writes. TrimTrailing drops spaces and tabs from
+    // the end of each row. CursorForward does too, and also writes runs of blank columns - the
+    // padding between columns, indents, alignment, justified gaps and expanded tabs - as cursor
+    // forward (CSI n C) sequences where they're shorter. That shows the same on a terminal, as
+    // long as the rows are written to blank lines
+    enum class Compaction { None, TrimTrailing, CursorForward };
+
     class Columns;
+    class Spacer;
+    class DiffRenderer;
+    class LineBreakIndex;
+    class LineMap;
+    class MultiWidthLayout;
+    class StreamColumn;
 
+    // With TEXTFLOW_CONFIG_ENABLE_THREADS defined, a Column can be shared between threads once
+    // it's been set up: iterating, rendering and measuring it (at any width) only read it, and any
+    // index built along the way is built once and then shared. Changing its settings must not
+    // overlap with any of that
     class Column {
-        std::vector<std::string> m_strings;
+        friend Columns;
+        friend LineBreakIndex;
+        friend LineMap;
+        friend MultiWidthLayout;
+        friend StreamColumn;
+        template<size_t, size_t, size_t> friend class FixedColumn;
+
+        Detail::ColumnText m_strings;
         size_t m_width = TEXTFLOW_CONFIG_CONSOLE_WIDTH;
         size_t m_indent = 0;
         size_t m_initialIndent = std::string::npos;
+        bool m_ansi = false;
+        size_t m_tabWidth = 0;
+        Alignment m_alignment = Alignment::Left;
+        Hyphenator const* m_hyphenator = nullptr;
+        Detail::HyphenBreaks m_hyphenBreaks = nullptr; // the hyphenator's breaks()
+        Detail::OnceCache<std::vector<Detail::StringBreaks>> m_breaks; // only depends on the text
+
+        auto breaks() const -> std::vector<Detail::StringBreaks> const& {
+            return m_breaks.get( [this] {
+                return std::vector<Detail::StringBreaks>( m_strings.begin(), m_strings.end() );
+            } );
+        }
+
+        // Where one wrapped line lies in the text - enough to render it again without re-wrapping
+        struct LineSpan {
+            size_t stringIndex;
+            size_t pos;
+            size_t len;
+            bool suffix;
+        };
+
+        auto lines() const -> std::vector<LineSpan>;
+
+#ifdef TEXTFLOW_CONFIG_ENABLE_THREADS
+        auto wrapFrom( size_t pos, size_t until, std::vector<LineSpan>& spans ) const -> size_t;
+        auto chunkCount( size_t threads, size_t minChunkSize ) const -> size_t;
+        auto lines( size_t threads, size_t minChunkSize ) const -> std::vector<LineSpan>;
+        void renderLines( std::vector<LineSpan> const& spans, size_t first, size_t last, std::string& out ) const;
+#endif
 
     public:
         class iterator {
             friend Column;
+            friend Columns;
+            friend LineBreakIndex;
+            friend LineMap;
+            friend MultiWidthLayout;
+            friend StreamColumn;
+            template<typename> friend class Detail::SliceSink;
+            template<size_t, size_t, size_t> friend class FixedColumn;
 
             Column const& m_column;
+            size_t m_width;
             size_t m_stringIndex = 0;
             size_t m_pos = 0;
 
             size_t m_len = 0;
-            size_t m_end = 0;
             bool m_suffix = false;
+            SgrState m_sgr; // active SGR state at m_pos, in ANSI mode
 
             iterator( Column const& column, size_t stringIndex )
             :   m_column( column ),
+                m_width( column.m_width ),
                 m_stringIndex( stringIndex )
             {}
 
-            auto line() const -> std::string const& { return m_column.m_strings[m_stringIndex]; }
+            // Wraps the column as if it were `width` wide
+            iterator( Column const& column, size_t stringIndex, size_t width )
+            :   m_column( column ),
+                m_width( width ),
+                m_stringIndex( stringIndex )
+            {
+                assert( m_width > m_column.m_indent );
+                assert( m_column.m_initialIndent == std::string::npos || m_width > m_column.m_initialIndent );
+                calcLength();
+                if( m_len == 0 )
+                    m_stringIndex++; // Empty string
+            }
 
-            auto isBoundary( size_t at ) const -> bool {
-                assert( at > 0 );
-                assert( at <= line().size() );
+            auto line() const -> StringRef { return m_column.m_strings[m_stringIndex]; }
+            auto exhausted() const -> bool { return m_stringIndex == m_column.m_strings.size(); }
 
-                return at == line().size() ||
-                       ( isWhitespace( line()[at] ) && !isWhitespace( line()[at-1] ) ) ||
-                       isBreakableBefore( line()[at] ) ||
-                       isBreakableAfter( line()[at-1] );
+            // Moves to a line previously found by wrapping, which must not be before this one
+            void seek( LineSpan const& span ) {
+                if( m_column.m_ansi ) {
+                    for(; m_stringIndex < span.stringIndex; ++m_stringIndex, m_pos = 0 )
+                        updateSgrState( m_sgr, line(), m_pos, line().size() );
+                    updateSgrState( m_sgr, line(), m_pos, span.pos );
+                }
+                m_stringIndex = span.stringIndex;
+                m_pos = span.pos;
+                m_len = span.len;
+                m_suffix = span.suffix;
+            }
+            void seekToEnd() {
+                m_stringIndex = m_column.m_strings.size();
+                m_pos = 0;
             }
 
             void calcLength() {
                 assert( m_stringIndex < m_column.m_strings.size() );
 
-                m_suffix = false;
-                auto width = m_column.m_width-indent();
-                m_end = m_pos;
-                if(!line().empty() && line()[m_pos] == '\n')
-                    ++m_end;
-                while( m_end < line().size() && line()[m_end] != '\n' )
-                    ++m_end;
+                auto extent = Detail::findLineExtent( line(), m_pos, m_width-indent(), m_column.m_ansi, m_column.m_tabWidth );
+                m_len = extent.len;
+                m_suffix = extent.suffix;
+                if( m_suffix && m_column.m_hyphenator )
+                    hyphenate();
+            }
+
+            // Moves a forced split back to the last place the word may be hyphenated that fits, if any
+            void hyphenate() {
+                auto text = line();
+                auto fitsUntil = m_pos + m_len;
+                auto wordStart = m_pos;
+                while( wordStart < fitsUntil && !Detail::isWordLetter( text[wordStart] ) )
+                    ++wordStart;
+                // The line may start part way through a word that was hyphenated on the previous one.
+                // Only as far as the longest word that's hyphenated is looked at either way
+                auto limit = Detail::maxHyphenatedWord + 1;
+                auto earliest = wordStart > limit ? wordStart - limit : 0;
+                while( wordStart > earliest && Detail::isWordLetter( text[wordStart-1] ) )
+                    --wordStart;
+                auto wordEnd = wordStart;
+                while( wordEnd < text.size() && wordEnd - wordStart <= limit && Detail::isWordLetter( text[wordEnd] ) )
+                    ++wordEnd;
+                if( wordStart == wordEnd || wordStart >= fitsUntil || wordEnd - wordStart > Detail::maxHyphenatedWord )
+                    return;
+
+                auto breaks = m_column.m_hyphenBreaks( *m_column.m_hyphenator, StringRef( text.data()+wordStart, wordEnd-wordStart ) );
+                auto fit = Detail::upperBound( breaks.begin(), breaks.end(), fitsUntil - wordStart );
+                if( fit != breaks.begin() && wordStart + *( fit-1 ) > m_pos )
+                    m_len = wordStart + *( fit-1 ) - m_pos;
+            }
+
+            auto nextPos() const -> size_t {
+                return Detail::nextLineStart( line(), m_pos + m_len, m_column.m_ansi );
+            }
+            void advance() {
+                auto start = m_pos;
+                m_pos = nextPos();
+                if( m_column.m_ansi )
+                    updateSgrState( m_sgr, line(), start, m_pos );
+            }
+
+            auto indent() const -> size_t {
+                auto initial = m_pos == 0 && m_stringIndex == 0 ? m_column.m_initialIndent : std::string::npos;
+                return initial == std::string::npos ? m_column.m_indent : initial;
+            }
+
+            // Columns the current line's text (and suffix) take up on screen, without the indent
+            auto textWidth() const -> size_t {
+                auto suffix = m_suffix ? 1 : 0;
+                if( !m_column.m_ansi && m_column.m_tabWidth == 0 )
+                    return m_len + suffix;
 
-                if( m_end < m_pos + width ) {
-                    m_len = m_end - m_pos;
+                auto text = line();
+                size_t cols = 0;
+                for( size_t at = m_pos; at < m_pos+m_len; ++at ) {
+                    if( auto escLen = m_column.m_ansi ? escapeSequenceLength( text, at ) : 0 )
+                        at += escLen-1;
+                    else
+                        cols += text[at] == '\t' ? Detail::tabSize( m_column.m_tabWidth, cols, m_width - indent() ) : 1;
+                }
+                return cols + suffix;
+            }
+
+            // Spaces between words - where a justified line gets its extra space
+            auto isGap( size_t at ) const -> bool {
+                return line()[at] == ' ' && at > m_pos && !isWhitespace( line()[at-1] );
+            }
+
+            // Whether the line ends a paragraph - at the end of the text or an explicit newline
+            auto endsParagraph() const -> bool {
+                auto text = line();
+                for( size_t at = m_pos+m_len; at < text.size() && isWhitespace( text[at] ); ++at )
+                    if( text[at] == '\n' )
+                        return true;
+                return nextPos() == text.size();
+            }
+
+            // Writes the current line, with its indent and suffix, to `out` after `padding` blank columns -
+            // expanding tabs and aligning it as we go. With `cursorForward`, runs of blank columns are written
+            // as cursor forward sequences where they're shorter (except within ANSI text, as they may be coloured).
+            // Returns how many columns the line takes up on screen, not counting the padding
+            auto appendTo( std::string& out, size_t padding = 0, bool cursorForward = false ) const -> size_t {
+                auto text = line();
+                auto lineLayout = layout();
+                Detail::appendBlank( out, padding + lineLayout.lead, cursorForward );
+                // Re-establish the rendition active at the start of the line
+                m_sgr.appendTo( out );
+
+                cursorForward = cursorForward && !m_column.m_ansi;
+                if( m_column.m_tabWidth == 0 && lineLayout.gaps == 0 && !cursorForward ) {
+                    out.append( text.data()+m_pos, m_len );
                 }
                 else {
-                    size_t len = width;
-                    while (len > 0 && !isBoundary(m_pos + len))
-                        --len;
-                    while (len > 0 && isWhitespace( line()[m_pos + len - 1] ))
-                        --len;
-
-                    if (len > 0) {
-                        m_len = len;
-                    } else {
-                        m_suffix = true;
-                        m_len = width - 1;
+                    size_t blank = 0; // spaces not written yet, so that each run is written in one go
+                    size_t cols = 0; // the extra spaces added by justifying don't move the tab stops
+                    size_t gap = 0;
+                    for( size_t at = m_pos; at < m_pos+m_len; ++at ) {
+                        if( auto escLen = m_column.m_ansi ? escapeSequenceLength( text, at ) : 0 ) {
+                            Detail::appendBlank( out, blank, cursorForward );
+                            blank = 0;
+                            out.append( text.data()+at, escLen );
+                            at += escLen-1;
+                            continue;
+                        }
+                        if( lineLayout.gaps > 0 && isGap( at ) ) {
+                            blank += lineLayout.extra / lineLayout.gaps + ( gap < lineLayout.extra % lineLayout.gaps ? 1 : 0 );
+                            ++gap;
+                        }
+                        if( text[at] == '\t' && m_column.m_tabWidth != 0 ) {
+                            auto spaces = Detail::tabSize( m_column.m_tabWidth, cols, m_width - indent() );
+                            blank += spaces;
+                            cols += spaces;
+                            continue;
+                        }
+                        if( text[at] == ' ' )
+                            ++blank;
+                        else {
+                            Detail::appendBlank( out, blank, cursorForward );
+                            blank = 0;
+                            out += text[at];
+                        }
+                        ++cols;
                     }
+                    Detail::appendBlank( out, blank, cursorForward );
+                }
+                if( m_suffix )
+                    out += '-';
+
+                // Reset anything still active at the end so it can't leak into padding
+                if( m_column.m_ansi ) {
+                    auto sgr = m_sgr;
+                    updateSgrState( sgr, text, m_pos, m_pos+m_len );
+                    if( !sgr.empty() )
+                        out += "\x1b[0m";
                 }
+                return lineLayout.lead + textWidth() + ( lineLayout.gaps > 0 ? lineLayout.extra : 0 );
             }
 
-            auto indent() const -> size_t {
-                auto initial = m_pos == 0 && m_stringIndex == 0 ? m_column.m_initialIndent : std::string::npos;
-                return initial == std::string::npos ? m_column.m_indent : initial;
+            // Where the current line's text starts on screen, and the space justifying spreads over its
+            // gaps - so that columns can be found just as appendTo would lay them out
+            struct Layout {
+                size_t lead;
+                size_t extra;
+                size_t gaps;
+            };
+            auto layout() const -> Layout {
+                Layout result{ indent(), 0, 0 };
+                if( m_column.m_alignment == Alignment::Left )
+                    return result;
+                auto available = m_width - indent();
+                auto width = textWidth();
+                auto extra = available > width ? available - width : 0;
+                if( m_column.m_alignment == Alignment::Right )
+                    result.lead += extra;
+                else if( m_column.m_alignment == Alignment::Centre )
+                    result.lead += extra / 2;
+                else if( extra > 0 && !endsParagraph() ) {
+                    result.extra = extra;
+                    for( size_t at = m_pos; at < m_pos+m_len; ++at )
+                        result.gaps += isGap( at ) ? 1 : 0;
+                }
+                return result;
+            }
+
+            // Walks the current line's characters as they're laid out, calling `stop( at, column, width )`
+            // for each (escape sequences are skipped), until it returns true. Returns where it stopped
+            template<typename Stop>
+            auto walkColumns( Stop stop ) const -> size_t {
+                auto text = line();
+                auto lineLayout = layout();
+                auto column = lineLayout.lead;
+                size_t cols = 0;
+                size_t gap = 0;
+                for( size_t at = m_pos; at < m_pos+m_len; ++at ) {
+                    if( auto escLen = m_column.m_ansi ? escapeSequenceLength( text, at ) : 0 ) {
+                        at += escLen-1;
+                        continue;
+                    }
+                    if( lineLayout.gaps > 0 && isGap( at ) ) {
+                        column += lineLayout.extra / lineLayout.gaps + ( gap < lineLayout.extra % lineLayout.gaps ? 1 : 0 );
+                        ++gap;
+                    }
+                    auto width = text[at] == '\t' && m_column.m_tabWidth != 0 ? Detail::tabSize( m_column.m_tabWidth, cols, m_width - indent() ) : 1;
+                    if( stop( at, column, width ) )
+                        return at;
+                    cols += width;
+                    column += width;
+                }
+                stop( m_pos+m_len, column, 0 );
+                return m_pos+m_len;
+            }
+
+            // The screen column byte `at` of the current line is drawn at. Bytes past the end of the
+            // line (and the end itself) give the column just after the line's text
+            auto columnOf( size_t at ) const -> size_t {
+                size_t found = 0;
+                walkColumns( [&]( size_t pos, size_t column, size_t ) {
+                    found = column;
+                    return pos >= at;
+                } );
+                return found;
+            }
+            // The byte of the current line drawn at screen column `column` - the line's first byte
+            // if that's in the indent, or the end of the line if it's past the text
+            auto offsetOf( size_t column ) const -> size_t {
+                return walkColumns( [&]( size_t, size_t start, size_t width ) {
+                    return column < start + width;
+                } );
             }
 
-            auto addIndentAndSuffix(std::string const &plain) const -> std::string {
-                return std::string( indent(), ' ' ) + (m_suffix ? plain + "-" : plain);
+            // Adds everything that decides how the current line looks to `hash`, without rendering it
+            void hashInto( Detail::Fnv1a& hash ) const {
+                hash.add( m_width );
+                hash.add( indent() );
+                hash.add( static_cast<size_t>( m_column.m_alignment ) );
+                hash.add( m_column.m_alignment == Alignment::Justify && endsParagraph() ? 1 : 0 );
+                hash.add( m_column.m_tabWidth );
+                hash.add( m_column.m_ansi ? 1 : 0 );
+                auto sgr = m_sgr.str();
+                hash.add( sgr.data(), sgr.size() );
+                hash.add( line().data()+m_pos, m_len );
+                hash.add( m_suffix ? 1 : 0 );
+            }
+
+            // Adds the current line to `out`, referring to the text rather than copying it where possible
+            auto appendTo( Detail::SliceBuffer& out, size_t padding = 0, bool cursorForward = false ) const -> size_t {
+                if( cursorForward || m_column.m_ansi || m_column.m_tabWidth != 0 || m_column.m_alignment != Alignment::Left ) {
+                    auto start = out.scratch().size();
+                    auto width = appendTo( out.scratch(), padding, cursorForward );
+                    out.appendScratch( start );
+                    return width;
+                }
+                out.append( padding + indent(), ' ' );
+                out.append( StringRef( line().data()+m_pos, m_len ) );
+                if( m_suffix )
+                    out.append( StringRef( "-", 1 ) );
+                return indent() + m_len + ( m_suffix ? 1 : 0 );
             }
 
         public:
@@ -118,28 +1360,17 @@ namespace TextFlow {
             using reference = value_type&;
             using iterator_category = std::forward_iterator_tag;
 
-            explicit iterator( Column const& column ) : m_column( column ) {
-                assert( m_column.m_width > m_column.m_indent );
-                assert( m_column.m_initialIndent == std::string::npos || m_column.m_width > m_column.m_initialIndent );
-                calcLength();
-                if( m_len == 0 )
-                    m_stringIndex++; // Empty string
-            }
+            explicit iterator( Column const& column ) : iterator( column, 0, column.m_width ) {}
 
             auto operator *() const -> std::string {
                 assert( m_stringIndex < m_column.m_strings.size() );
-                assert( m_pos <= m_end );
-                return addIndentAndSuffix(line().substr(m_pos, m_len));
+                std::string out;
+                appendTo( out );
+                return out;
             }
 
             auto operator ++() -> iterator& {
-                m_pos += m_len;
-                if( m_pos < line().size() && line()[m_pos] == '\n' )
-                    m_pos += 1;
-                else
-                    while( m_pos < line().size() && isWhitespace( line()[m_pos] ) )
-                        ++m_pos;
-
+                advance();
                 if( m_pos == line().size() ) {
                     m_pos = 0;
                     ++m_stringIndex;
@@ -166,7 +1397,9 @@ namespace TextFlow {
         };
         using const_iterator = iterator;
 
-        explicit Column( std::string const& text ) { m_strings.push_back( text ); }
+        explicit Column( std::string const& text ) : m_strings( text ) {}
+        // Wraps text held elsewhere (such as in a MappedFile) without copying it - so it must outlive the column
+        explicit Column( StringRef text ) : m_strings( text ) {}
 
         auto width( size_t newWidth ) -> Column& {
             assert( newWidth > 0 );
@@ -181,61 +1414,765 @@ namespace TextFlow {
             m_initialIndent = newIndent;
             return *this;
         }
+        // Treat ANSI escape sequences as zero width, carrying colours across wrapped lines
+        auto ansi( bool enabled = true ) -> Column& {
+            m_ansi = enabled;
+            return *this;
+        }
+        // Expand tabs to the next multiple of `newTabWidth` columns, counted from the indent.
+        // The default, 0, leaves tabs unexpanded and counts them as a single column
+        auto tabWidth( size_t newTabWidth ) -> Column& {
+            m_tabWidth = newTabWidth;
+            return *this;
+        }
+        auto align( Alignment alignment ) -> Column& {
+            m_alignment = alignment;
+            return *this;
+        }
+#ifdef TEXTFLOW_CONFIG_ENABLE_HYPHENATION
+        // Hyphenate words too long for a line where `hyphenator` allows, rather than just splitting
+        // them where they reach the width. It's referred to, so must outlive the column
+        auto hyphenate( Hyphenator const& hyphenator ) -> Column& {
+            m_hyphenator = &hyphenator;
+            m_hyphenBreaks = []( Hyphenator const& h, StringRef word ) { return h.breaks( word ); };
+            return *this;
+        }
+#endif
 
         auto width() const -> size_t { return m_width; }
         auto begin() const -> iterator { return iterator( *this ); }
+        // Iterates the lines as if the column were `newWidth` wide, without changing it
+        // (so threads sharing the column can each wrap it to a different width)
+        auto begin( size_t newWidth ) const -> iterator { return { *this, 0, newWidth }; }
         auto end() const -> iterator { return { *this, m_strings.size() }; }
 
-        inline friend std::ostream& operator << ( std::ostream& os, Column const& col ) {
+        auto operator + ( Column const& other ) -> Columns;
+        auto operator + ( Spacer const& spacer ) -> Columns;
+
+        // Measures the column without rendering it (see LineBreakIndex, which does the work)
+        auto height( size_t width ) const -> size_t;
+        auto maxLineWidth( size_t width ) const -> size_t;
+        auto minWidth() const -> size_t;
+        auto widthFor( size_t lines ) const -> size_t;
+
+        auto toString() const -> std::string {
+            std::string out;
+            bool first = true;
+            for( auto it = begin(), itEnd = end(); it != itEnd; ++it ) {
+                if( first )
+                    first = false;
+                else
+                    out += '\n';
+                it.appendTo( out );
+            }
+            return out;
+        }
+
+#ifdef TEXTFLOW_CONFIG_ENABLE_THREADS
+        // Same output as toString(), but long text is wrapped (and rendered) across up to `threads`
+        // threads - even a single paragraph. It's split into chunks, and each chunk after the first
+        // is wrapped from a guess at where a line starts in it. Each seam is then fixed up by
+        // wrapping on from the last line known to be right until a line starts where one of the
+        // guessed ones does - from there on they're the same, and greedy wrapping soon gets back
+        // in step. Text with no such place (e.g. one huge word) is just wrapped in one thread.
+        // Chunks are at least `minChunkSize` bytes, as smaller ones aren't worth a thread of their own
+        auto toString( size_t threads, size_t minChunkSize = 64*1024 ) const -> std::string;
+#endif
+    };
+
+    // The places a column's text may be broken, found once up front, so that the number
+    // of lines it wraps to can then be found for any width without re-scanning the text.
+    // Only refers to the column, which must outlive it. The breaks are kept by the column,
+    // so are only found once however many indices (in however many threads) use them
+    class LineBreakIndex {
+        friend MultiWidthLayout;
+
+        Column const& m_column;
+        std::vector<Detail::StringBreaks> const& m_breaks;
+
+        auto skipToNextLine( StringRef text, size_t pos ) const -> size_t {
+            if( pos < text.size() && text[pos] == '\n' )
+                return pos+1;
+            while( pos < text.size() && isWhitespace( text[pos] ) )
+                ++pos;
+            return pos;
+        }
+
+        // Follows the same steps as Column::iterator, but jumps between boundaries - calling
+        // `onLine( pos, len, suffix )` for each line of the string
+        template<typename OnLine>
+        void wrapString( size_t stringIndex, size_t firstWidth, size_t width, OnLine onLine ) const {
+            auto text = m_column.m_strings[stringIndex];
+            auto const& breaks = m_breaks[stringIndex];
+
+            for( size_t pos = 0, available = firstWidth; pos < text.size(); available = width ) {
+                auto nl = Detail::upperBound( breaks.newlines.begin(), breaks.newlines.end(), pos );
+                auto lineEnd = nl == breaks.newlines.end() ? text.size() : *nl;
+                if( lineEnd - pos < available ) {
+                    onLine( pos, lineEnd - pos, false );
+                    pos = skipToNextLine( text, lineEnd );
+                    continue;
+                }
+                auto b = Detail::upperBound( breaks.boundaries.begin(), breaks.boundaries.end(), pos + available );
+                auto trimmed = b == breaks.boundaries.begin() ? pos : breaks.trimmed[static_cast<size_t>( b - breaks.boundaries.begin() ) - 1];
+                auto end = trimmed > pos ? trimmed : pos + available - 1;
+                onLine( pos, end - pos, trimmed <= pos );
+                pos = skipToNextLine( text, end );
+            }
+        }
+
+        // Whether the text has to be wrapped for real, rather than by jumping between boundaries:
+        // tab stops and escape sequences mean columns aren't bytes, and hyphenation depends on the words
+        auto needsWrapping() const -> bool {
+            return m_column.m_ansi || m_column.m_tabWidth != 0 || m_column.m_hyphenator;
+        }
+        auto firstIndent( size_t stringIndex ) const -> size_t {
+            return stringIndex == 0 && m_column.m_initialIndent != std::string::npos
+                ? m_column.m_initialIndent
+                : m_column.m_indent;
+        }
+
+        // The lines the column wraps to at `width`, as Column::lines() finds them
+        auto lines( size_t width ) const -> std::vector<Column::LineSpan> {
+            assert( width > m_column.m_indent+1 );
+            assert( m_column.m_initialIndent == std::string::npos || width > m_column.m_initialIndent+1 );
+            std::vector<Column::LineSpan> spans;
+            if( needsWrapping() ) {
+                for( auto it = m_column.begin( width ); !it.exhausted(); ++it )
+                    spans.push_back( { it.m_stringIndex, it.m_pos, it.m_len, it.m_suffix } );
+                return spans;
+            }
+            for( size_t i = 0; i < m_breaks.size(); ++i ) {
+                wrapString( i, width - firstIndent( i ), width - m_column.m_indent, [&]( size_t pos, size_t len, bool suffix ) {
+                    spans.push_back( { i, pos, len, suffix } );
+                } );
+            }
+            return spans;
+        }
+
+        // Calls `onLine( columns, suffix )` for each line the column wraps to at `width`, with the
+        // columns its indent, text and any hyphen take up (alignment only moves lines within the width)
+        template<typename OnLine>
+        void measureLines( size_t width, OnLine onLine ) const {
+            assert( width > m_column.m_indent+1 );
+            assert( m_column.m_initialIndent == std::string::npos || width > m_column.m_initialIndent+1 );
+
+            // Wrap for real if need be (but don't render)
+            if( needsWrapping() ) {
+                for( Column::iterator it( m_column, 0, width ); !it.exhausted(); ++it )
+                    onLine( it.indent() + it.textWidth(), it.m_suffix );
+                return;
+            }
+            for( size_t i = 0; i < m_breaks.size(); ++i ) {
+                auto indent = firstIndent( i );
+                wrapString( i, width - indent, width - m_column.m_indent, [&]( size_t, size_t len, bool suffix ) {
+                    onLine( indent + len + ( suffix ? 1 : 0 ), suffix );
+                    indent = m_column.m_indent;
+                } );
+            }
+        }
+
+        // The narrowest width worth trying, and one wide enough for any paragraph to fit on a line
+        auto minimumWidth() const -> size_t {
+            return ( m_column.m_initialIndent == std::string::npos ? m_column.m_indent : Detail::maxOf( m_column.m_indent, m_column.m_initialIndent ) ) + 2;
+        }
+        auto maximumWidth() const -> size_t {
+            size_t size = 0;
+            for( auto const& text : m_column.m_strings )
+                size += text.size();
+            return minimumWidth() + size * Detail::maxOf( m_column.m_tabWidth, size_t( 1 ) );
+        }
+
+        // The narrowest width in [min, max] that `fits`, which must hold for all widths above one that it holds for
+        template<typename Fits>
+        static auto narrowest( size_t min, size_t max, Fits fits ) -> size_t {
+            while( min < max ) {
+                auto mid = min + ( max - min ) / 2;
+                if( fits( mid ) )
+                    max = mid;
+                else
+                    min = mid+1;
+            }
+            return min;
+        }
+
+    public:
+        explicit LineBreakIndex( Column const& column ) : m_column( column ), m_breaks( column.breaks() ) {}
+
+        // None of these render anything, or allocate per line
+
+        // The number of lines the column would wrap to at the given width
+        auto height( size_t width ) const -> size_t {
+            size_t lines = 0;
+            measureLines( width, [&]( size_t, bool ) { ++lines; } );
+            return lines;
+        }
+
+        // The most columns any line takes up at the given width
+        auto maxLineWidth( size_t width ) const -> size_t {
+            size_t widest = 0;
+            measureLines( width, [&]( size_t columns, bool ) { widest = Detail::maxOf( widest, columns ); } );
+            return widest;
+        }
+
+        // The narrowest width at which no word has to be split (or hyphenated) - the longest run
+        // of text that can't be broken, plus the indent
+        auto minWidth() const -> size_t {
+            return narrowest( minimumWidth(), maximumWidth(), [this]( size_t width ) {
+                bool split = false;
+                measureLines( width, [&]( size_t, bool suffix ) { split = split || suffix; } );
+                return !split;
+            } );
+        }
+
+        // The narrowest width at which the column fits in `lines` lines, or npos if it doesn't
+        // fit at any width (as it has more paragraphs than that)
+        auto widthFor( size_t lines ) const -> size_t {
+            auto widest = maximumWidth();
+            if( height( widest ) > lines )
+                return std::string::npos;
+            return narrowest( minimumWidth(), widest, [&]( size_t width ) { return height( width ) <= lines; } );
+        }
+    };
+
+    inline auto Column::height( size_t width ) const -> size_t { return LineBreakIndex( *this ).height( width ); }
+    inline auto Column::maxLineWidth( size_t width ) const -> size_t { return LineBreakIndex( *this ).maxLineWidth( width ); }
+    inline auto Column::minWidth() const -> size_t { return LineBreakIndex( *this ).minWidth(); }
+    inline auto Column::widthFor( size_t lines ) const -> size_t { return LineBreakIndex( *this ).widthFor( lines ); }
+
+    // A place in wrapped text: the line (counting from 0) and the screen column within it
+    // (counting from the left edge of the column, so including the indent)
+    struct TextPosition {
+        size_t line;
+        size_t column;
+
+        auto operator ==( TextPosition const& other ) const -> bool {
+            return line == other.line && column == other.column;
+        }
+        auto operator !=( TextPosition const& other ) const -> bool {
+            return !operator==( other );
+        }
+    };
+
+    // Maps between byte offsets into a column's text and where they end up once it's wrapped,
+    // in either direction - e.g. to highlight a search hit, or to place a cursor. The column is
+    // wrapped once, up front, keeping where each line starts, so finding the line is a binary
+    // search and finding the column only looks at that line. Indents, alignment, tabs and escape
+    // sequences are all accounted for. Hyphens added at a split don't come from the text, so no
+    // offset maps to one. Only refers to the column, which must outlive it (and not be changed)
+    class LineMap {
+        Column const& m_column;
+        size_t m_width;
+        std::vector<Column::LineSpan> m_lines;
+        std::vector<size_t> m_starts; // the offset each line starts at
+        std::vector<size_t> m_bases; // the offset each of the column's strings starts at
+
+        auto lineAt( size_t line ) const -> Column::iterator {
+            Column::iterator it( m_column, m_lines[line].stringIndex );
+            it.m_width = m_width;
+            it.m_pos = m_lines[line].pos;
+            it.m_len = m_lines[line].len;
+            it.m_suffix = m_lines[line].suffix;
+            return it;
+        }
+
+    public:
+        explicit LineMap( Column const& column ) : LineMap( column, column.width() ) {}
+        // Maps the text as if the column were `width` wide
+        LineMap( Column const& column, size_t width ) : m_column( column ), m_width( width ) {
+            size_t base = 0;
+            for( auto const& text : column.m_strings ) {
+                m_bases.push_back( base );
+                base += text.size();
+            }
+            for( auto it = column.begin( width ), itEnd = column.end(); it != itEnd; ++it ) {
+                m_lines.push_back( { it.m_stringIndex, it.m_pos, it.m_len, it.m_suffix } );
+                m_starts.push_back( m_bases[it.m_stringIndex] + it.m_pos );
+            }
+        }
+
+        auto lineCount() const -> size_t { return m_lines.size(); }
+
+        // Where the byte at `offset` is drawn. Whitespace dropped where a line was wrapped is
+        // placed just after the end of the line before it
+        auto toPosition( size_t offset ) const -> TextPosition {
+            if( m_lines.empty() )
+                return { 0, 0 };
+            auto next = Detail::upperBound( m_starts.begin(), m_starts.end(), offset );
+            auto line = next == m_starts.begin() ? 0 : static_cast<size_t>( next - m_starts.begin() ) - 1;
+            auto at = m_lines[line].pos + ( offset - m_starts[line] );
+            return { line, lineAt( line ).columnOf( Detail::minOf( at, m_lines[line].pos + m_lines[line].len ) ) };
+        }
+
+        // The offset of the byte drawn at `position`. A column in the indent gives the line's
+        // first byte; one past the end of its text (or on an added hyphen) gives the end of it
+        auto toOffset( TextPosition position ) const -> size_t {
+            assert( position.line < m_lines.size() );
+            auto const& span = m_lines[position.line];
+            return m_bases[span.stringIndex] + lineAt( position.line ).offsetOf( position.column );
+        }
+    };
+
+    // Lays a column out at several widths at once (say, for narrow, standard and wide screens).
+    // The text is only scanned once, for the places it may be broken, then each width's lines
+    // are found by jumping between those - so adding a width costs about as much as the number
+    // of lines it has, not the length of the text. (With tabs, escape sequences or hyphenation,
+    // each width is wrapped in full). Each layout can then be rendered on its own. Only refers
+    // to the column, which must outlive it (and not be changed)
+    class MultiWidthLayout {
+        Column const& m_column;
+        std::vector<size_t> m_widths;
+        std::vector<std::vector<Column::LineSpan>> m_lines;
+
+    public:
+        MultiWidthLayout( Column const& column, std::vector<size_t> widths )
+        :   m_column( column ),
+            m_widths( std::move( widths ) )
+        {
+            LineBreakIndex index( column );
+            for( auto width : m_widths )
+                m_lines.push_back( index.lines( width ) );
+        }
+
+        auto size() const -> size_t { return m_widths.size(); }
+        auto width( size_t layout ) const -> size_t { return m_widths[layout]; }
+        // The number of lines in the layout
+        auto height( size_t layout ) const -> size_t { return m_lines[layout].size(); }
+
+        // The same as the column's toString() at the layout's width
+        auto toString( size_t layout ) const -> std::string {
+            Column::iterator it( m_column, 0 );
+            it.m_width = m_widths[layout];
+            std::string out;
+            for( auto const& span : m_lines[layout] ) {
+                if( &span != &m_lines[layout].front() )
+                    out += '\n';
+                it.seek( span );
+                it.appendTo( out );
+            }
+            return out;
+        }
+    };
+
+#ifdef TEXTFLOW_CONFIG_ENABLE_STREAMING
+    // Wraps text read a chunk at a time - from a std::istream, or any function that fills a
+    // buffer - so it never needs to be in memory all at once. Only the text from the start of the
+    // current line, and enough after it to be sure where that line ends, is kept (so memory use
+    // is around the width plus a chunk, unless the text has very long runs of whitespace).
+    // Set the layout before reading any lines; lines can only be read once
+    class StreamColumn {
+    public:
+        // Fills the buffer with up to `size` bytes, returning how many, or 0 at the end
+        using ChunkReader = std::function<size_t( char* buffer, size_t size )>;
+
+    private:
+        ChunkReader m_reader;
+        size_t m_chunkSize;
+        std::string m_buffer; // the text read but not yet written out
+        Column m_column;      // refers to the buffer
+        Column::iterator m_it;
+        bool m_started = false;
+        bool m_eof = false;
+
+        auto text() -> std::string& { return m_buffer; }
+
+        void read() {
+            auto size = m_buffer.size();
+            m_buffer.resize( size + m_chunkSize );
+            auto read = m_reader( &m_buffer[size], m_chunkSize );
+            m_buffer.resize( size + read );
+            m_column.m_strings[0] = StringRef( m_buffer );
+            m_eof = read == 0;
+        }
+
+    public:
+        explicit StreamColumn( ChunkReader reader, size_t chunkSize = 64*1024 )
+        :   m_reader( std::move( reader ) ),
+            m_chunkSize( chunkSize ),
+            m_column( StringRef() ),
+            m_it( m_column, 0 )
+        {
+            assert( chunkSize > 0 );
+        }
+        // Reads from a std::istream - or anything else with its read() and gcount()
+        template<typename IStream, typename = decltype( std::declval<IStream&>().gcount() )>
+        explicit StreamColumn( IStream& is, size_t chunkSize = 64*1024 )
+        :   StreamColumn( [&is]( char* buffer, size_t size ) -> size_t {
+                              is.read( buffer, static_cast<decltype( is.gcount() )>( size ) );
+                              return static_cast<size_t>( is.gcount() );
+                          },
+                          chunkSize )
+        {}
+        StreamColumn( StreamColumn const& ) = delete;
+        auto operator = ( StreamColumn const& ) -> StreamColumn& = delete;
+
+        auto width( size_t newWidth ) -> StreamColumn& {
+            m_column.width( newWidth );
+            m_it.m_width = newWidth;
+            return *this;
+        }
+        auto indent( size_t newIndent ) -> StreamColumn& {
+            m_column.indent( newIndent );
+            return *this;
+        }
+        auto initialIndent( size_t newIndent ) -> StreamColumn& {
+            m_column.initialIndent( newIndent );
+            return *this;
+        }
+        auto ansi( bool enabled = true ) -> StreamColumn& {
+            m_column.ansi( enabled );
+            return *this;
+        }
+        auto tabWidth( size_t newTabWidth ) -> StreamColumn& {
+            m_column.tabWidth( newTabWidth );
+            return *this;
+        }
+
+        // Reads the next wrapped line into `line`, returning false once there are none left
+        auto nextLine( std::string& line ) -> bool {
+            if( !m_started ) {
+                assert( m_column.m_width > m_column.m_indent );
+                assert( m_column.m_initialIndent == std::string::npos || m_column.m_width > m_column.m_initialIndent );
+                m_started = true;
+                while( text().empty() && !m_eof )
+                    read();
+                if( text().empty() )
+                    m_it.seekToEnd();
+            }
+            if( m_it.exhausted() )
+                return false;
+
+            // Until we know the line doesn't run up to the end of what's been read so far,
+            // its end might be different once we have more
+            for(;;) {
+                m_it.calcLength();
+                if( m_eof || m_it.nextPos() < text().size() )
+                    break;
+                read();
+            }
+            line.clear();
+            m_it.appendTo( line );
+
+            m_it.advance();
+            m_column.m_initialIndent = std::string::npos; // Only for the first line
+            if( m_it.m_pos == text().size() )
+                m_it.seekToEnd();
+            else if( m_it.m_pos >= m_chunkSize ) {
+                m_buffer.erase( 0, m_it.m_pos );
+                m_column.m_strings[0] = StringRef( m_buffer );
+                m_it.m_pos = 0;
+            }
+            return true;
+        }
+    };
+#endif // TEXTFLOW_CONFIG_ENABLE_STREAMING
+
+    // Blank space between the columns of a layout. It has no text, so isn't a Column - Columns
+    // just adds its width to the padding before the next column, with nothing to wrap or iterate
+    class Spacer {
+        size_t m_width;
+
+    public:
+        explicit Spacer( size_t spaceWidth ) : m_width( spaceWidth ) {}
+
+        auto width( size_t newWidth ) -> Spacer& {
+            m_width = newWidth;
+            return *this;
+        }
+        auto width() const -> size_t { return m_width; }
+
+        auto operator + ( Column const& other ) const -> Columns;
+        auto operator + ( Spacer const& other ) const -> Columns;
+    };
+
+    // A Column whose width and indents are fixed at compile time, so that its lines are found with
+    // them as constants. To combine it with others into Columns, take it as an ordinary Column with column()
+    template<size_t Width, size_t Indent = 0, size_t InitialIndent = std::string::npos>
+    class FixedColumn : Column {
+        static_assert( Width > Indent, "The indent must leave room for the text" );
+        static_assert( InitialIndent == std::string::npos || Width > InitialIndent, "The initial indent must leave room for the text" );
+
+        static constexpr size_t FirstIndent = InitialIndent == std::string::npos ? Indent : InitialIndent;
+
+    public:
+        class iterator {
+            friend FixedColumn;
+
+            Column::iterator m_it;
+
+            explicit iterator( Column::iterator it ) : m_it( it ) {}
+
+            void calcLength() {
+                auto const& column = m_it.m_column;
+                auto extent = m_it.m_pos == 0 && m_it.m_stringIndex == 0
+                    ? Detail::findLineExtent( m_it.line(), 0, std::integral_constant<size_t, Width - FirstIndent>(), column.m_ansi, column.m_tabWidth )
+                    : Detail::findLineExtent( m_it.line(), m_it.m_pos, std::integral_constant<size_t, Width - Indent>(), column.m_ansi, column.m_tabWidth );
+                m_it.m_len = extent.len;
+                m_it.m_suffix = extent.suffix;
+                if( m_it.m_suffix && column.m_hyphenator )
+                    m_it.hyphenate();
+            }
+
+        public:
+            using difference_type = std::ptrdiff_t;
+            using value_type = std::string;
+            using pointer = value_type*;
+            using reference = value_type&;
+            using iterator_category = std::forward_iterator_tag;
+
+            auto operator *() const -> std::string { return *m_it; }
+
+            auto operator ++() -> iterator& {
+                m_it.advance();
+                if( m_it.m_pos == m_it.line().size() ) {
+                    m_it.m_pos = 0;
+                    ++m_it.m_stringIndex;
+                }
+                if( !m_it.exhausted() )
+                    calcLength();
+                return *this;
+            }
+            auto operator ++(int) -> iterator {
+                iterator prev( *this );
+                operator++();
+                return prev;
+            }
+
+            auto operator ==( iterator const& other ) const -> bool { return m_it == other.m_it; }
+            auto operator !=( iterator const& other ) const -> bool { return m_it != other.m_it; }
+        };
+        using const_iterator = iterator;
+
+        explicit FixedColumn( std::string const& text ) : Column( text ) {
+            m_width = Width;
+            m_indent = Indent;
+            m_initialIndent = InitialIndent;
+        }
+        explicit FixedColumn( StringRef text ) : Column( text ) {
+            m_width = Width;
+            m_indent = Indent;
+            m_initialIndent = InitialIndent;
+        }
+
+        auto ansi( bool enabled = true ) -> FixedColumn& {
+            Column::ansi( enabled );
+            return *this;
+        }
+        auto tabWidth( size_t newTabWidth ) -> FixedColumn& {
+            Column::tabWidth( newTabWidth );
+            return *this;
+        }
+        auto align( Alignment alignment ) -> FixedColumn& {
+            Column::align( alignment );
+            return *this;
+        }
+#ifdef TEXTFLOW_CONFIG_ENABLE_HYPHENATION
+        auto hyphenate( Hyphenator const& hyphenator ) -> FixedColumn& {
+            Column::hyphenate( hyphenator );
+            return *this;
+        }
+#endif
+
+        auto width() const -> size_t { return Width; }
+
+        auto begin() const -> iterator {
+            iterator it( Column::iterator( *this, 0 ) );
+            it.calcLength();
+            if( it.m_it.m_len == 0 )
+                it.m_it.m_stringIndex++; // Empty string
+            return it;
+        }
+        auto end() const -> iterator { return iterator( Column::end() ); }
+
+        using Column::height;
+        using Column::maxLineWidth;
+        using Column::minWidth;
+        using Column::widthFor;
+
+        // A copy as an ordinary Column (whose lines are found with the width and indents as variables)
+        auto column() const -> Column { return *this; }
+
+        auto toString() const -> std::string {
+            std::string out;
             bool first = true;
-            for( auto line : col ) {
+            for( auto it = begin(), itEnd = end(); it != itEnd; ++it ) {
                 if( first )
                     first = false;
                 else
-                    os << "\n";
-                os <<  line;
+                    out += '\n';
+                it.m_it.appendTo( out );
             }
-            return os;
+            return out;
         }
+    };
 
-        auto operator + ( Column const& other ) -> Columns;
+    class Columns {
+        std::vector<Column> m_columns;
+        std::vector<size_t> m_spacing; // the space from Spacers before each column
+        size_t m_trailingSpace = 0; // and after the last
+        Compaction m_compaction = Compaction::None;
 
-        auto toString() const -> std::string {
-            std::ostringstream oss;
-            oss << *this;
-            return oss.str();
+        using LineTable = std::vector<Column::LineSpan>;
+
+        void wrapColumns( std::vector<LineTable>& tables, size_t first, size_t step ) const {
+            for( size_t i = first; i < m_columns.size(); i += step )
+                tables[i] = m_columns[i].lines();
         }
-    };
 
-    class Spacer : public Column {
+        // Writes out, row by row, columns that have already been wrapped
+        auto zipRows( std::vector<LineTable> const& tables ) const -> std::string {
+            size_t rows = 0;
+            for( auto const& table : tables )
+                rows = Detail::maxOf( rows, table.size() );
+
+            iterator it( *this, iterator::SeekTag() );
+            std::string out;
+            out.reserve( rows * ( it.rowWidth() + 1 ) );
+            for( size_t row = 0; row < rows; ++row ) {
+                for( size_t i = 0; i < tables.size(); ++i ) {
+                    if( row < tables[i].size() )
+                        it.m_iterators[i].seek( tables[i][row] );
+                    else
+                        it.m_iterators[i].seekToEnd();
+                }
+                if( row > 0 )
+                    out += '\n';
+                it.appendRow( out );
+            }
+            return out;
+        }
 
     public:
-        explicit Spacer( size_t spaceWidth ) : Column( "" ) {
-            width( spaceWidth );
+        struct WidthRange {
+            size_t min;
+            size_t max;
+        };
+
+    private:
+        // Fills in the narrowest widths that fit the columns into `rows`, returning their total (or npos)
+        static auto narrowestFits( std::vector<LineBreakIndex> const& indices, std::vector<WidthRange> const& limits, size_t rows, std::vector<size_t>& widths ) -> size_t {
+            size_t total = 0;
+            for( size_t i = 0; i < indices.size(); ++i ) {
+                widths[i] = narrowestFit( indices[i], limits[i], rows );
+                if( widths[i] == std::string::npos )
+                    return std::string::npos;
+                total += widths[i];
+            }
+            return total;
         }
-    };
 
-    class Columns {
-        std::vector<Column> m_columns;
+        // The narrowest width in `range` at which the column fits in `rows`, or npos if none does
+        static auto narrowestFit( LineBreakIndex const& index, WidthRange range, size_t rows ) -> size_t {
+            if( range.min == range.max )
+                return range.min;
+            if( index.height( range.max ) > rows )
+                return std::string::npos;
+            while( range.min < range.max ) {
+                auto mid = range.min + ( range.max - range.min ) / 2;
+                if( index.height( mid ) <= rows )
+                    range.max = mid;
+                else
+                    range.min = mid+1;
+            }
+            return range.min;
+        }
 
     public:
 
         class iterator {
             friend Columns;
+            friend DiffRenderer;
+            friend std::ostream& operator << ( std::ostream& os, Columns const& cols );
+            template<typename> friend class Detail::SliceSink;
             struct EndTag {};
+            struct SeekTag {};
 
             std::vector<Column> const& m_columns;
-            std::vector<Column::iterator> m_iterators;
+            std::vector<size_t> const& m_spacing;
+            size_t m_trailingSpace;
+            Compaction m_compaction;
+            Detail::SmallVector<Column::iterator, 8> m_iterators;
             size_t m_activeIterators;
+            size_t m_row = 0;
 
+            // The end iterator has no column iterators - it just has none active
             iterator( Columns const& columns, EndTag )
             :   m_columns( columns.m_columns ),
+                m_spacing( columns.m_spacing ),
+                m_trailingSpace( columns.m_trailingSpace ),
+                m_compaction( columns.m_compaction ),
+                m_iterators( 0 ),
                 m_activeIterators( 0 )
-            {
-                m_iterators.reserve( m_columns.size() );
+            {}
 
+            // Has unpositioned column iterators, to be moved with seek()
+            iterator( Columns const& columns, SeekTag )
+            :   m_columns( columns.m_columns ),
+                m_spacing( columns.m_spacing ),
+                m_trailingSpace( columns.m_trailingSpace ),
+                m_compaction( columns.m_compaction ),
+                m_iterators( m_columns.size() ),
+                m_activeIterators( m_columns.size() )
+            {
                 for( auto const& col : m_columns )
-                    m_iterators.push_back( col.end() );
+                    m_iterators.push_back( Column::iterator( col, 0 ) );
+            }
+
+            auto rowWidth() const -> size_t {
+                size_t width = m_trailingSpace;
+                for( size_t i = 0; i < m_columns.size(); ++i )
+                    width += m_spacing[i] + m_columns[i].width();
+                return width;
+            }
+
+            static auto trimTrailing( std::string& row, size_t from, char const* chars ) -> size_t {
+                auto end = row.find_last_not_of( chars );
+                auto size = row.size();
+                row.resize( end == std::string::npos || end < from ? from : end+1 );
+                return size - row.size();
+            }
+            static auto trimTrailing( Detail::SliceBuffer& row, size_t from, char const* chars ) -> size_t {
+                return row.trimTrailing( from, chars );
+            }
+
+            // A hash of everything that decides how the current row looks, found without rendering it
+            auto rowHash() const -> uint64_t {
+                Detail::Fnv1a hash;
+                hash.add( static_cast<size_t>( m_compaction ) );
+                for( size_t i = 0; i < m_columns.size(); ++i ) {
+                    hash.add( m_spacing[i] );
+                    hash.add( m_columns[i].width() );
+                    if( m_iterators[i].exhausted() )
+                        hash.add( std::string::npos );
+                    else
+                        m_iterators[i].hashInto( hash );
+                }
+                return hash.value();
+            }
+
+            // Appends the current row to `row` (a std::string or SliceBuffer). Padding is only written
+            // once a later column has something to show, so rows never have trailing padding
+            template<typename Out>
+            void appendRow( Out& row ) const {
+                auto start = row.size();
+                size_t padding = 0;
+
+                for( size_t i = 0; i < m_columns.size(); ++i ) {
+                    auto width = m_columns[i].width();
+                    padding += m_spacing[i];
+                    if( !m_iterators[i].exhausted() ) {
+                        // Spaces at the end of the previous column can be skipped over too
+                        if( m_compaction == Compaction::CursorForward && padding > 0 )
+                            padding += trimTrailing( row, start, " " );
+                        auto colWidth = m_iterators[i].appendTo( row, padding, m_compaction == Compaction::CursorForward );
+                        padding = colWidth < width ? width - colWidth : 0;
+                    }
+                    else {
+                        padding += width;
+                    }
+                }
+                if( m_compaction != Compaction::None )
+                    trimTrailing( row, start, " \t" );
             }
 
         public:
@@ -247,44 +2184,44 @@ namespace TextFlow {
 
             explicit iterator( Columns const& columns )
             :   m_columns( columns.m_columns ),
-                m_activeIterators( m_columns.size() )
+                m_spacing( columns.m_spacing ),
+                m_trailingSpace( columns.m_trailingSpace ),
+                m_compaction( columns.m_compaction ),
+                m_iterators( m_columns.size() ),
+                m_activeIterators( 0 )
             {
-                m_iterators.reserve( m_columns.size() );
-
-                for( auto const& col : m_columns )
+                for( auto const& col : m_columns ) {
                     m_iterators.push_back( col.begin() );
+                    if( !m_iterators[m_iterators.size()-1].exhausted() )
+                        ++m_activeIterators;
+                }
             }
 
+            // Once every column is exhausted we're at the end, otherwise iterators
+            // over the same columns are at the same place if they're on the same row
             auto operator ==( iterator const& other ) const -> bool {
-                return m_iterators == other.m_iterators;
+                return m_activeIterators == 0 || other.m_activeIterators == 0
+                    ? m_activeIterators == other.m_activeIterators
+                    : m_row == other.m_row && &m_columns == &other.m_columns;
             }
             auto operator !=( iterator const& other ) const -> bool {
-                return m_iterators != other.m_iterators;
+                return !operator==( other );
             }
             auto operator *() const -> std::string {
-                std::string row, padding;
-
-                for( size_t i = 0; i < m_columns.size(); ++i ) {
-                    auto width = m_columns[i].width();
-                    if( m_iterators[i] != m_columns[i].end() ) {
-                        std::string col = *m_iterators[i];
-                        row += padding + col;
-                        if( col.size() < width )
-                            padding = std::string( width - col.size(), ' ' );
-                        else
-                            padding = "";
-                    }
-                    else {
-                        padding += std::string( width, ' ' );
-                    }
-                }
+                std::string row;
+                row.reserve( rowWidth() );
+                appendRow( row );
                 return row;
             }
             auto operator ++() -> iterator& {
-                for( size_t i = 0; i < m_columns.size(); ++i ) {
-                    if (m_iterators[i] != m_columns[i].end())
+                for( size_t i = 0; i < m_iterators.size(); ++i ) {
+                    if( !m_iterators[i].exhausted() ) {
                         ++m_iterators[i];
+                        if( m_iterators[i].exhausted() )
+                            --m_activeIterators;
+                    }
                 }
+                ++m_row;
                 return *this;
             }
             auto operator ++(int) -> iterator {
@@ -300,6 +2237,12 @@ namespace TextFlow {
 
         auto operator += ( Column const& col ) -> Columns& {
             m_columns.push_back( col );
+            m_spacing.push_back( m_trailingSpace );
+            m_trailingSpace = 0;
+            return *this;
+        }
+        auto operator += ( Spacer const& spacer ) -> Columns& {
+            m_trailingSpace += spacer.width();
             return *this;
         }
         auto operator + ( Column const& col ) -> Columns {
@@ -307,26 +2250,401 @@ namespace TextFlow {
             combined += col;
             return combined;
         }
+        auto operator + ( Spacer const& spacer ) -> Columns {
+            Columns combined = *this;
+            combined += spacer;
+            return combined;
+        }
+        auto compact( Compaction compaction ) -> Columns& {
+            m_compaction = compaction;
+            return *this;
+        }
+
+        // Sets the column widths, within `totalWidth` overall, so the layout takes as few rows as possible.
+        // `limits` may give the range each column's width must stay in. By default columns may be anything
+        // from just wider than their indent up to the total width - except empty ones, which keep their
+        // current width. Limits below that narrowest width (just wider than the indent) are raised to it.
+        // Spacers keep their width, and aren't given limits
+        auto fitWidths( size_t totalWidth, std::vector<WidthRange> limits = {} ) -> Columns& {
+            assert( limits.empty() || limits.size() == m_columns.size() );
+            auto spacing = m_trailingSpace;
+            for( auto space : m_spacing )
+                spacing += space;
+            totalWidth = totalWidth > spacing ? totalWidth - spacing : 0;
+            bool defaultLimits = limits.empty();
+            for( size_t i = 0; i < m_columns.size(); ++i ) {
+                auto const& col = m_columns[i];
+                auto indent = col.m_initialIndent == std::string::npos ? col.m_indent : Detail::maxOf( col.m_indent, col.m_initialIndent );
+                if( defaultLimits ) {
+                    bool empty = true;
+                    for( auto const& text : col.m_strings )
+                        empty = empty && text.empty();
+                    limits.push_back( empty ? WidthRange{ col.width(), col.width() } : WidthRange{ indent+2, Detail::maxOf( totalWidth, indent+2 ) } );
+                }
+                else {
+                    limits[i].min = Detail::maxOf( limits[i].min, indent+2 );
+                    limits[i].max = Detail::maxOf( limits[i].max, limits[i].min );
+                }
+            }
+
+            std::vector<LineBreakIndex> indices;
+            indices.reserve( m_columns.size() );
+            for( auto const& col : m_columns )
+                indices.emplace_back( col );
+
+            // Binary search for the fewest rows that the columns can fit in, between
+            // what they take when all at their widest and all at their narrowest
+            size_t fewestRows = 0, mostRows = 0, minTotal = 0;
+            for( size_t i = 0; i < m_columns.size(); ++i ) {
+                minTotal += limits[i].min;
+                if( limits[i].min == limits[i].max )
+                    continue;
+                fewestRows = Detail::maxOf( fewestRows, indices[i].height( limits[i].max ) );
+                mostRows = Detail::maxOf( mostRows, indices[i].height( limits[i].min ) );
+            }
+
+            std::vector<size_t> widths( m_columns.size() );
+            for( size_t i = 0; i < m_columns.size(); ++i )
+                widths[i] = limits[i].min;
+
+            if( minTotal < totalWidth ) {
+                std::vector<size_t> fitted( m_columns.size() );
+                while( fewestRows < mostRows ) {
+                    auto rows = fewestRows + ( mostRows - fewestRows ) / 2;
+                    if( narrowestFits( indices, limits, rows, fitted ) <= totalWidth )
+                        mostRows = rows;
+                    else
+                        fewestRows = rows+1;
+                }
+                auto total = narrowestFits( indices, limits, mostRows, fitted );
+                if( total <= totalWidth )
+                    widths = fitted;
+                else
+                    total = minTotal;
+                size_t spare = totalWidth - total;
 
-        inline friend std::ostream& operator << ( std::ostream& os, Columns const& cols ) {
+                // Share out what's left, a column at a time
+                for( bool growing = true; spare > 0 && growing; ) {
+                    growing = false;
+                    for( size_t i = 0; i < m_columns.size() && spare > 0; ++i ) {
+                        if( widths[i] < limits[i].max ) {
+                            ++widths[i];
+                            --spare;
+                            growing = true;
+                        }
+                    }
+                }
+            }
+
+            for( size_t i = 0; i < m_columns.size(); ++i )
+                m_columns[i].width( widths[i] );
+            return *this;
+        }
 
+        auto toString() const -> std::string {
+            std::string out;
             bool first = true;
-            for( auto line : cols ) {
+            for( auto it = begin(), itEnd = end(); it != itEnd; ++it ) {
                 if( first )
                     first = false;
                 else
-                    os << "\n";
-                os << line;
+                    out += '\n';
+                it.appendRow( out );
             }
-            return os;
+            return out;
         }
 
-        auto toString() const -> std::string {
-            std::ostringstream oss;
-            oss << *this;
-            return oss.str();
+        // Same output as toString(), but wraps each column in turn before writing out
+        // the rows - which keeps to one source string at a time for wide layouts
+        auto toStringByColumn() const -> std::string {
+            std::vector<LineTable> tables( m_columns.size() );
+            wrapColumns( tables, 0, 1 );
+            return zipRows( tables );
+        }
+
+#ifdef TEXTFLOW_CONFIG_ENABLE_THREADS
+        // As toStringByColumn(), but the columns are wrapped across up to `threads` threads
+        auto toStringByColumn( size_t threads ) const -> std::string {
+            std::vector<LineTable> tables( m_columns.size() );
+            threads = Detail::minOf( Detail::maxOf( threads, size_t( 1 ) ), m_columns.size() );
+
+            std::vector<std::thread> workers;
+            for( size_t t = 1; t < threads; ++t )
+                workers.emplace_back( &Columns::wrapColumns, this, std::ref( tables ), t, threads );
+            wrapColumns( tables, 0, threads );
+            for( auto& worker : workers )
+                worker.join();
+
+            return zipRows( tables );
+        }
+#endif
+    };
+
+    // Redraws a layout on a terminal frame by frame, only writing the rows that have changed since
+    // the last frame. Rows are compared by hashing what they're made from (the text of each line,
+    // and the settings that affect it), so unchanged rows aren't even rendered
+    class DiffRenderer {
+        size_t m_top;
+        std::vector<uint64_t> m_rowHashes; // of the rows on screen, from the last frame
+
+        void moveTo( std::string& out, size_t row ) const {
+            out += "\x1b[";
+            out += std::to_string( m_top + row );
+            out += ";1H";
+        }
+
+    public:
+        // Frames are drawn from screen row `top` (counting from 1, as terminals do) down
+        explicit DiffRenderer( size_t top = 1 ) : m_top( top ) {}
+
+        // What to write to the terminal to update it from the last frame to `layout`: for each row
+        // that changed, a move to that row, the row, then an erase to the end of the line.
+        // Rows the last frame had but this one doesn't are erased. Rows are written over the last
+        // frame's, so cursor movements can't stand in for blanks: Compaction::CursorForward is
+        // treated as TrimTrailing
+        auto render( Columns const& layout ) -> std::string {
+            std::string out;
+            size_t row = 0;
+            auto it = layout.begin();
+            if( it.m_compaction == Compaction::CursorForward )
+                it.m_compaction = Compaction::TrimTrailing;
+            for( auto itEnd = layout.end(); it != itEnd; ++it, ++row ) {
+                auto hash = it.rowHash();
+                if( row < m_rowHashes.size() ) {
+                    if( m_rowHashes[row] == hash )
+                        continue;
+                    m_rowHashes[row] = hash;
+                }
+                else
+                    m_rowHashes.push_back( hash );
+                moveTo( out, row );
+                it.appendRow( out );
+                out += "\x1b[K";
+            }
+            for( auto old = row; old < m_rowHashes.size(); ++old ) {
+                moveTo( out, old );
+                out += "\x1b[K";
+            }
+            m_rowHashes.resize( row );
+            return out;
+        }
+
+        // Forgets what's on screen, so the next frame is drawn in full (e.g. after the screen was cleared)
+        void invalidate() { m_rowHashes.clear(); }
+    };
+
+    namespace Detail {
+        // Writes Column and Columns lines out in batches of slices, using Sink::flush().
+        // As slices refer to the text being written, everything is flushed before write() returns
+        template<typename Sink>
+        class SliceSink {
+            auto sink() -> Sink& { return static_cast<Sink&>( *this ); }
+
+            void appendLine( Column::iterator const& it ) { it.appendTo( m_slices ); }
+            void appendLine( Columns::iterator const& it ) { it.appendRow( m_slices ); }
+
+            template<typename Lines>
+            auto writeLines( Lines const& lines ) -> Sink& {
+                bool first = true;
+                for( auto it = lines.begin(), itEnd = lines.end(); it != itEnd; ++it ) {
+                    if( first )
+                        first = false;
+                    else
+                        m_slices.append( StringRef( "\n", 1 ) );
+                    appendLine( it );
+                    if( m_slices.size() >= 1024 )
+                        sink().flush();
+                }
+                sink().flush();
+                return sink();
+            }
+
+        protected:
+            SliceBuffer m_slices;
+
+        public:
+            // Lines are separated by newlines, as with operator <<
+            auto write( Column const& col ) -> Sink& { return writeLines( col ); }
+            auto write( Columns const& cols ) -> Sink& { return writeLines( cols ); }
+            auto write( StringRef text ) -> Sink& {
+                m_slices.append( text );
+                sink().flush();
+                return sink();
+            }
+            auto write( char const* text ) -> Sink& { return write( StringRef( text, std::strlen( text ) ) ); }
+        };
+    } // namespace Detail
+
+    // Writes lines to a C stdio stream, with fwrite. Check ferror() for errors
+    class FileSink : public Detail::SliceSink<FileSink> {
+        std::FILE* m_file;
+
+    public:
+        explicit FileSink( std::FILE* file ) : m_file( file ) {}
+
+        void flush() {
+            m_slices.forEach( [this]( char const* data, size_t size ) {
+                std::fwrite( data, 1, size, m_file );
+            } );
+            m_slices.clear();
+        }
+    };
+
+#ifdef TEXTFLOW_CONFIG_ENABLE_POSIX_IO
+    // Writes lines to a file descriptor, gathering many lines into each writev() call.
+    // Throws std::system_error if a write fails
+    class FdSink : public Detail::SliceSink<FdSink> {
+        int m_fd;
+
+        void writeAll( std::vector<iovec>& iov ) {
+            size_t first = 0;
+            while( first < iov.size() ) {
+                auto count = Detail::minOf( iov.size() - first, static_cast<size_t>( IOV_MAX ) );
+                auto written = ::writev( m_fd, &iov[first], static_cast<int>( count ) );
+                if( written < 0 ) {
+                    if( errno == EINTR )
+                        continue;
+                    throw std::system_error( errno, std::generic_category(), "writev" );
+                }
+                // Skip what was written, which may have stopped part way through a slice
+                for( auto size = static_cast<size_t>( written ); size > 0; ) {
+                    if( size >= iov[first].iov_len )
+                        size -= iov[first++].iov_len;
+                    else {
+                        iov[first].iov_base = static_cast<char*>( iov[first].iov_base ) + size;
+                        iov[first].iov_len -= size;
+                        size = 0;
+                    }
+                }
+            }
+        }
+
+    public:
+        explicit FdSink( int fd ) : m_fd( fd ) {}
+
+        void flush() {
+            std::vector<iovec> iov;
+            iov.reserve( m_slices.size() );
+            m_slices.forEach( [&]( char const* data, size_t size ) {
+                iov.push_back( { const_cast<char*>( data ), size } );
+            } );
+            writeAll( iov );
+            m_slices.clear();
         }
     };
+#endif // TEXTFLOW_CONFIG_ENABLE_POSIX_IO
+
+    inline auto Column::lines() const -> std::vector<LineSpan> {
+        std::vector<LineSpan> spans;
+        for( auto it = begin(), itEnd = end(); it != itEnd; ++it )
+            spans.push_back( { it.m_stringIndex, it.m_pos, it.m_len, it.m_suffix } );
+        return spans;
+    }
+
+#ifdef TEXTFLOW_CONFIG_ENABLE_THREADS
+    // Adds the lines of the text that start from `pos`, up to the first that starts at or after
+    // `until`, to `spans` - returning where that line starts (or the end of the text)
+    inline auto Column::wrapFrom( size_t pos, size_t until, std::vector<LineSpan>& spans ) const -> size_t {
+        iterator it( *this, 0 );
+        it.m_pos = pos;
+        for( auto size = m_strings.front().size(); it.m_pos < until && it.m_pos < size; it.m_pos = it.nextPos() ) {
+            it.calcLength();
+            spans.push_back( { 0, it.m_pos, it.m_len, it.m_suffix } );
+        }
+        return it.m_pos;
+    }
+
+    // How many chunks the text is split into to wrap it in parallel - fewer than 2 if it's not split at all
+    inline auto Column::chunkCount( size_t threads, size_t minChunkSize ) const -> size_t {
+        if( m_strings.size() != 1 )
+            return 1;
+        return Detail::minOf( threads, m_strings.front().size() / Detail::maxOf( minChunkSize, size_t( 1 ) ) );
+    }
+
+    inline auto Column::lines( size_t threads, size_t minChunkSize ) const -> std::vector<LineSpan> {
+        auto chunks = chunkCount( threads, minChunkSize );
+        if( chunks < 2 )
+            return lines();
+        auto text = m_strings.front();
+
+        std::vector<size_t> bounds( chunks+1 );
+        for( size_t k = 0; k <= chunks; ++k )
+            bounds[k] = text.size() / chunks * k;
+        bounds[chunks] = text.size();
+
+        // Lines can start anywhere the last one ended, so any place will do as a guess - but
+        // after whitespace is the likeliest
+        std::vector<std::vector<LineSpan>> guesses( chunks );
+        std::vector<size_t> ends( chunks );
+        auto speculate = [&]( size_t k ) {
+            auto guess = k == 0 ? 0 : Detail::nextLineStart( text, bounds[k], m_ansi );
+            ends[k] = wrapFrom( guess, bounds[k+1], guesses[k] );
+        };
+        std::vector<std::thread> workers;
+        for( size_t k = 1; k < chunks; ++k )
+            workers.emplace_back( speculate, k );
+        speculate( 0 );
+        for( auto& worker : workers )
+            worker.join();
+
+        // As the iterator does, text that starts with an empty line has no lines at all
+        auto spans = std::move( guesses[0] );
+        if( spans.front().len == 0 )
+            return {};
+        auto pos = ends[0];
+        for( size_t k = 1; k < chunks; ++k ) {
+            auto const& guess = guesses[k];
+            while( pos < bounds[k+1] ) {
+                auto match = Detail::partitionPoint( guess.begin(), guess.end(), [pos]( LineSpan const& span ) {
+                    return span.pos < pos;
+                } );
+                if( match != guess.end() && match->pos == pos ) {
+                    spans.insert( spans.end(), match, guess.end() );
+                    pos = ends[k];
+                    break;
+                }
+                pos = wrapFrom( pos, pos+1, spans );
+            }
+        }
+        return spans;
+    }
+
+    // Renders lines [first, last) of `spans` to `out`, each but the first after a newline
+    inline void Column::renderLines( std::vector<LineSpan> const& spans, size_t first, size_t last, std::string& out ) const {
+        iterator it( *this, 0 );
+        for( auto i = first; i < last; ++i ) {
+            if( i > 0 )
+                out += '\n';
+            it.seek( spans[i] );
+            it.appendTo( out );
+        }
+    }
+
+    inline auto Column::toString( size_t threads, size_t minChunkSize ) const -> std::string {
+        // With nothing to split, finding the lines first would only add to the work
+        if( chunkCount( threads, minChunkSize ) < 2 )
+            return toString();
+        auto spans = lines( threads, minChunkSize );
+        threads = Detail::minOf( Detail::maxOf( threads, size_t( 1 ) ), spans.size() / 1024 + 1 );
+
+        // In ANSI mode each line needs the rendition left active by all the ones before it
+        std::string out;
+        if( m_ansi || threads < 2 ) {
+            renderLines( spans, 0, spans.size(), out );
+            return out;
+        }
+        std::vector<std::string> parts( threads );
+        std::vector<std::thread> workers;
+        for( size_t t = 1; t < threads; ++t )
+            workers.emplace_back( &Column::renderLines, this, std::cref( spans ), spans.size() * t / threads, spans.size() * ( t+1 ) / threads, std::ref( parts[t] ) );
+        renderLines( spans, 0, spans.size() / threads, out );
+        for( size_t t = 1; t < threads; ++t ) {
+            workers[t-1].join();
+            out += parts[t];
+        }
+        return out;
+    }
+#endif
 
     inline auto Column::operator + ( Column const& other ) -> Columns {
         Columns cols;
@@ -334,6 +2652,319 @@ namespace TextFlow {
         cols += other;
         return cols;
     }
+    inline auto Column::operator + ( Spacer const& spacer ) -> Columns {
+        Columns cols;
+        cols += *this;
+        cols += spacer;
+        return cols;
+    }
+    inline auto Spacer::operator + ( Column const& other ) const -> Columns {
+        Columns cols;
+        cols += *this;
+        cols += other;
+        return cols;
+    }
+    inline auto Spacer::operator + ( Spacer const& other ) const -> Columns {
+        Columns cols;
+        cols += *this;
+        cols += other;
+        return cols;
+    }
+
+#ifndef TEXTFLOW_CONFIG_DISABLE_IOSTREAMS
+    inline std::ostream& operator << ( std::ostream& os, Column const& col ) {
+        bool first = true;
+        for( auto line : col ) {
+            if( first )
+                first = false;
+            else
+                os << "\n";
+            os <<  line;
+        }
+        return os;
+    }
+
+    inline std::ostream& operator << ( std::ostream& os, Columns const& cols ) {
+        // One buffer, sized for a full row, is reused for every row
+        std::string row;
+        bool first = true;
+        for( auto it = cols.begin(), itEnd = cols.end(); it != itEnd; ++it ) {
+            if( first ) {
+                first = false;
+                row.reserve( it.rowWidth() );
+            }
+            else
+                os << "\n";
+            row.clear();
+            it.appendRow( row );
+            os << row;
+        }
+        return os;
+    }
+
+    template<size_t Width, size_t Indent, size_t InitialIndent>
+    inline std::ostream& operator << ( std::ostream& os, FixedColumn<Width, Indent, InitialIndent> const& col ) {
+        return os << col.toString();
+    }
+
+#ifdef TEXTFLOW_CONFIG_ENABLE_STREAMING
+    inline std::ostream& operator << ( std::ostream& os, StreamColumn& col ) {
+        std::string line;
+        for( bool first = true; col.nextLine( line ); first = false ) {
+            if( !first )
+                os << "\n";
+            os << line;
+        }
+        return os;
+    }
+#endif
+#endif // TEXTFLOW_CONFIG_DISABLE_IOSTREAMS
+
+#if defined( __cpp_nontype_template_args ) && __cpp_nontype_template_args >= 201911L
+    // A string held by value, so that a literal can be passed as a template argument
+    // and text can be built at compile time. Holds N-1 characters and a terminating null
+    template<size_t N>
+    struct StaticString {
+        char chars[N] = {};
+
+        constexpr StaticString() = default;
+        constexpr StaticString( char const ( &text )[N] ) {
+            for( size_t i = 0; i < N; ++i )
+                chars[i] = text[i];
+        }
+
+        constexpr auto size() const -> size_t { return N-1; }
+        constexpr auto c_str() const -> char const* { return chars; }
+        constexpr auto ref() const -> StringRef { return StringRef( chars, N-1 ); }
+        auto str() const -> std::string { return std::string( chars, N-1 ); }
+    };
+
+    namespace Detail {
+        // Counts the characters written to it - and stores them too, if given somewhere to put them
+        struct StaticWriter {
+            char* chars = nullptr;
+            size_t size = 0;
+
+            constexpr void append( size_t count, char c ) {
+                for(; count > 0; --count, ++size )
+                    if( chars )
+                        chars[size] = c;
+            }
+            constexpr void append( char const* text, size_t length ) {
+                for( size_t i = 0; i < length; ++i, ++size )
+                    if( chars )
+                        chars[size] = text[i];
+            }
+        };
+
+        constexpr auto wrappedSize( StringRef text, size_t width, size_t indent, size_t initialIndent ) -> size_t {
+            StaticWriter counter;
+            wrapTo( text, width, indent, initialIndent, counter );
+            return counter.size;
+        }
+    } // namespace Detail
+
+    // Wraps a string literal at compile time, giving the same text as
+    // Column( Text ).width( Width ).indent( Indent ).initialIndent( InitialIndent ).toString()
+    // e.g. constexpr auto help = wrapLiteral<"Some usage text", 40, 2>();
+    template<StaticString Text, size_t Width = TEXTFLOW_CONFIG_CONSOLE_WIDTH, size_t Indent = 0, size_t InitialIndent = std::string::npos>
+    constexpr auto wrapLiteral() {
+        static_assert( Width > Indent, "The indent must leave room for the text" );
+        static_assert( InitialIndent == std::string::npos || Width > InitialIndent, "The initial indent must leave room for the text" );
+
+        StaticString<Detail::wrappedSize( Text.ref(), Width, Indent, InitialIndent )+1> wrapped;
+        Detail::StaticWriter writer{ wrapped.chars };
+        Detail::wrapTo( Text.ref(), Width, Indent, InitialIndent, writer );
+        return wrapped;
+    }
+#endif
+
+#ifdef TEXTFLOW_CONFIG_ENABLE_COROUTINES
+    // A lazily evaluated sequence of values, produced by a coroutine that co_yields them
+    template<typename T>
+    class Generator {
+    public:
+        struct promise_type {
+            T* m_value = nullptr;
+            std::exception_ptr m_error;
+
+            auto get_return_object() -> Generator { return Generator( std::coroutine_handle<promise_type>::from_promise( *this ) ); }
+            auto initial_suspend() noexcept -> std::suspend_always { return {}; }
+            auto final_suspend() noexcept -> std::suspend_always { return {}; }
+            auto yield_value( T& value ) noexcept -> std::suspend_always {
+                m_value = std::addressof( value );
+                return {};
+            }
+            auto yield_value( T&& value ) noexcept -> std::suspend_always {
+                m_value = std::addressof( value );
+                return {};
+            }
+            void return_void() noexcept {}
+            void unhandled_exception() { m_error = std::current_exception(); }
+            void await_transform() = delete;
+        };
+
+        class iterator {
+            std::coroutine_handle<promise_type> m_handle;
+
+            void resume() {
+                m_handle.resume();
+                if( m_handle.done() && m_handle.promise().m_error )
+                    std::rethrow_exception( m_handle.promise().m_error );
+            }
+
+        public:
+            using difference_type = std::ptrdiff_t;
+            using value_type = T;
+            using reference = T&;
+            using iterator_category = std::input_iterator_tag;
+
+            explicit iterator( std::coroutine_handle<promise_type> handle ) : m_handle( handle ) {
+                if( m_handle )
+                    resume();
+            }
+
+            auto operator *() const -> T& { return *m_handle.promise().m_value; }
+            auto operator ++() -> iterator& {
+                resume();
+                return *this;
+            }
+            void operator ++(int) { operator++(); }
+
+            auto operator ==( std::default_sentinel_t ) const -> bool { return !m_handle || m_handle.done(); }
+        };
+
+    private:
+        std::coroutine_handle<promise_type> m_handle;
+
+        explicit Generator( std::coroutine_handle<promise_type> handle ) : m_handle( handle ) {}
+
+    public:
+        Generator( Generator&& other ) noexcept : m_handle( std::exchange( other.m_handle, nullptr ) ) {}
+        auto operator = ( Generator&& other ) noexcept -> Generator& {
+            std::swap( m_handle, other.m_handle );
+            return *this;
+        }
+        ~Generator() {
+            if( m_handle )
+                m_handle.destroy();
+        }
+
+        // Starts the coroutine running - so can only be called once
+        auto begin() -> iterator { return iterator( m_handle ); }
+        auto end() -> std::default_sentinel_t { return {}; }
+    };
+
+    // Each line of the column, wrapped as it's asked for. The column must outlive the generator
+    inline auto generateLines( Column const& col ) -> Generator<std::string> {
+        for( auto it = col.begin(), itEnd = col.end(); it != itEnd; ++it )
+            co_yield *it;
+    }
+    inline auto generateLines( Columns const& cols ) -> Generator<std::string> {
+        for( auto it = cols.begin(), itEnd = cols.end(); it != itEnd; ++it )
+            co_yield *it;
+    }
+#ifdef TEXTFLOW_CONFIG_ENABLE_STREAMING
+    // Reads and wraps text only as lines are asked for, e.g. as they can be written out
+    inline auto generateLines( StreamColumn& col ) -> Generator<std::string> {
+        std::string line;
+        while( col.nextLine( line ) )
+            co_yield line;
+    }
+
+    // Lets a StreamColumn read its text from a generator of chunks - such as a decoder or
+    // decompressor written as a coroutine - which then runs only when more text is needed
+    inline auto readChunksFrom( Generator<std::string>& chunks ) -> StreamColumn::ChunkReader {
+        struct State {
+            Generator<std::string>& chunks;
+            std::optional<Generator<std::string>::iterator> it;
+            size_t offset = 0;
+        };
+        auto state = std::make_shared<State>( State{ chunks, std::nullopt, 0 } );
+        return [state]( char* buffer, size_t size ) -> size_t {
+            auto& it = state->it;
+            if( !it )
+                it.emplace( state->chunks.begin() );
+            for(; *it != state->chunks.end(); ++*it, state->offset = 0 ) {
+                auto const& chunk = **it;
+                if( state->offset < chunk.size() ) {
+                    auto read = Detail::minOf( size, chunk.size() - state->offset );
+                    std::memcpy( buffer, chunk.data() + state->offset, read );
+                    state->offset += read;
+                    return read;
+                }
+            }
+            return 0;
+        };
+    }
+#endif // TEXTFLOW_CONFIG_ENABLE_STREAMING
+
+#ifdef TEXTFLOW_CONFIG_ENABLE_THREADS
+    // Runs `source` on a thread of its own, up to `capacity` values ahead of the consumer. Chain these
+    // to overlap stages - e.g. decoding input, wrapping it, and writing the lines out - across threads
+    template<typename T>
+    auto runAhead( Generator<T> source, size_t capacity = 64 ) -> Generator<T> {
+        struct Channel {
+            std::mutex mutex;
+            std::condition_variable changed;
+            std::deque<T> values;
+            bool done = false;
+            bool cancelled = false;
+            std::exception_ptr error;
+        };
+        auto channel = std::make_shared<Channel>();
+
+        std::thread producer( [channel, capacity]( Generator<T> values ) {
+            try {
+                for( auto&& value : values ) {
+                    std::unique_lock<std::mutex> lock( channel->mutex );
+                    channel->changed.wait( lock, [&]{ return channel->values.size() < capacity || channel->cancelled; } );
+                    if( channel->cancelled )
+                        break;
+                    channel->values.push_back( std::move( value ) );
+                    channel->changed.notify_all();
+                }
+            }
+            catch( ... ) {
+                std::lock_guard<std::mutex> lock( channel->mutex );
+                channel->error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock( channel->mutex );
+            channel->done = true;
+            channel->changed.notify_all();
+        }, std::move( source ) );
+
+        // Stops, and waits for, the producer however this coroutine ends (including being destroyed early)
+        struct Stopper {
+            std::thread& producer;
+            Channel& channel;
+            ~Stopper() {
+                {
+                    std::lock_guard<std::mutex> lock( channel.mutex );
+                    channel.cancelled = true;
+                    channel.changed.notify_all();
+                }
+                producer.join();
+            }
+        } stopper{ producer, *channel };
+
+        for(;;) {
+            std::unique_lock<std::mutex> lock( channel->mutex );
+            channel->changed.wait( lock, [&]{ return !channel->values.empty() || channel->done; } );
+            if( channel->values.empty() ) {
+                if( channel->error )
+                    std::rethrow_exception( channel->error );
+                co_return;
+            }
+            T value = std::move( channel->values.front() );
+            channel->values.pop_front();
+            channel->changed.notify_all();
+            lock.unlock();
+            co_yield value;
+        }
+    }
+#endif // TEXTFLOW_CONFIG_ENABLE_THREADS
+#endif // TEXTFLOW_CONFIG_ENABLE_COROUTINES
 }
 
 #endif // TEXTFLOW_HPP_INCLUDED
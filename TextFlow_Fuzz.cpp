@@ -0,0 +1,199 @@
+// Differential fuzzing of TextFlow against TextFlow_Reference.hpp, a frozen copy of the original
+// implementation. Every way of wrapping and rendering that should give the same output as the
+// original is checked, byte for byte, against it - and any difference aborts.
+//
+// Built with libFuzzer where the compiler has it (clang, -fsanitize=fuzzer). Otherwise, with
+// TEXTFLOW_FUZZ_STANDALONE defined, it runs each file given on the command line as an input,
+// or a run of random inputs if there are none.
+
+#include "TextFlow.hpp"
+#include "TextFlow_Reference.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+
+    using TextFlow::Column;
+    using TextFlow::Columns;
+    using TextFlow::Spacer;
+
+    void check( bool ok, char const* what, std::string const& text ) {
+        if( !ok ) {
+            std::fprintf( stderr, "Mismatch in %s, for text (%u bytes):\n%s\n", what, static_cast<unsigned>( text.size() ), text.c_str() );
+            std::abort();
+        }
+    }
+
+    // Collects what a slice sink writes
+    class StringSink : public TextFlow::Detail::SliceSink<StringSink> {
+    public:
+        std::string out;
+
+        void flush() {
+            m_slices.forEach( [this]( char const* data, size_t size ) { out.append( data, size ); } );
+            m_slices.clear();
+        }
+    };
+
+    auto joinLines( Column::iterator it, Column::iterator end ) -> std::string {
+        std::string out;
+        for( bool first = true; it != end; ++it, first = false ) {
+            if( !first )
+                out += '\n';
+            out += *it;
+        }
+        return out;
+    }
+
+    // Lines can contain newlines themselves, so they have to be counted rather than the newlines
+    auto referenceHeight( TextFlowReference::Column const& ref ) -> size_t {
+        size_t lines = 0;
+        for( auto it = ref.begin(), itEnd = ref.end(); it != itEnd; ++it )
+            ++lines;
+        return lines;
+    }
+
+    // The first few bytes choose the layout, and the rest is the text (split between two columns)
+    void fuzz( uint8_t const* data, size_t size ) {
+        if( size < 5 )
+            return;
+        size_t width = 2 + data[0] % 60;
+        size_t indent = data[1] % ( width-1 );
+        size_t initialIndent = data[2] == 0xff ? std::string::npos : data[2] % ( width-1 );
+        size_t otherWidth = 2 + data[3] % 30;
+        size_t chunkSize = 1 + data[4] % 16;
+        auto input = std::string( reinterpret_cast<char const*>( data+5 ), size-5 );
+        auto split = input.empty() ? 0 : data[4] % input.size();
+        auto text = input.substr( 0, split );
+        auto other = input.substr( split );
+
+        auto col = Column( text ).width( width ).indent( indent ).initialIndent( initialIndent );
+        auto ref = TextFlowReference::Column( text ).width( width ).indent( indent );
+        if( initialIndent != std::string::npos )
+            ref.initialIndent( initialIndent );
+        auto expected = ref.toString();
+
+        check( col.toString() == expected, "Column::toString", text );
+        check( joinLines( col.begin(), col.end() ) == expected, "Column::iterator", text );
+#ifdef TEXTFLOW_CONFIG_ENABLE_THREADS
+        // With chunks small enough for the text to be split between threads
+        check( col.toString( 3, 1 + chunkSize ) == expected, "Column::toString( threads )", text );
+#endif
+        check( Column( TextFlow::StringRef( text ) ).width( width ).indent( indent ).initialIndent( initialIndent ).toString() == expected, "Column( StringRef )", text );
+        check( TextFlow::LineBreakIndex( col ).height( width ) == referenceHeight( ref ), "LineBreakIndex", text );
+
+        std::string wrapped;
+        TextFlow::Detail::wrapTo( text, width, indent, initialIndent, wrapped );
+        check( wrapped == expected, "Detail::wrapTo", text );
+
+        StringSink sink;
+        sink.write( col );
+        check( sink.out == expected, "SliceSink", text );
+
+        size_t read = 0;
+        TextFlow::StreamColumn stream( [&]( char* buffer, size_t bufferSize ) -> size_t {
+            auto n = (std::min)( bufferSize, text.size() - read );
+            text.copy( buffer, n, read );
+            read += n;
+            return n;
+        }, chunkSize );
+        stream.width( width ).indent( indent ).initialIndent( initialIndent );
+        std::string streamed;
+        std::string line;
+        for( bool first = true; stream.nextLine( line ); first = false ) {
+            if( !first )
+                streamed += '\n';
+            streamed += line;
+        }
+        check( streamed == expected, "StreamColumn", text );
+
+        // Settings that shouldn't change anything for this text
+        TextFlow::Hyphenator noPatterns( "" );
+        check( Column( col ).hyphenate( noPatterns ).toString() == expected, "hyphenate (no patterns)", text );
+        check( Column( col ).align( TextFlow::Alignment::Left ).toString() == expected, "align( Left )", text );
+        if( text.find( '\x1b' ) == std::string::npos )
+            check( Column( col ).ansi().toString() == expected, "ansi", text );
+
+        // Wrapping the shared column at another width
+        auto anotherWidth = ( initialIndent == std::string::npos ? indent : (std::max)( indent, initialIndent ) ) + otherWidth;
+        auto refOther = TextFlowReference::Column( text ).width( anotherWidth ).indent( indent );
+        if( initialIndent != std::string::npos )
+            refOther.initialIndent( initialIndent );
+        check( joinLines( col.begin( anotherWidth ), col.end() ) == refOther.toString(), "Column::begin( width )", text );
+
+        TextFlow::MultiWidthLayout layouts( col, { width, anotherWidth } );
+        check( layouts.toString( 0 ) == expected, "MultiWidthLayout", text );
+        check( layouts.toString( 1 ) == refOther.toString(), "MultiWidthLayout (another width)", text );
+
+        check( TextFlow::FixedColumn<20, 2>( text ).toString() == TextFlowReference::Column( text ).width( 20 ).indent( 2 ).toString(), "FixedColumn", text );
+
+        auto layout = col + Spacer( 3 ) + Column( other ).width( otherWidth );
+        auto refLayout = ref + TextFlowReference::Spacer( 3 ) + TextFlowReference::Column( other ).width( otherWidth );
+        auto expectedLayout = refLayout.toString();
+        check( layout.toString() == expectedLayout, "Columns::toString", text + other );
+        check( layout.toStringByColumn() == expectedLayout, "Columns::toStringByColumn", text + other );
+#ifdef TEXTFLOW_CONFIG_ENABLE_THREADS
+        check( layout.toStringByColumn( 3 ) == expectedLayout, "Columns::toStringByColumn( threads )", text + other );
+#endif
+        StringSink layoutSink;
+        layoutSink.write( layout );
+        check( layoutSink.out == expectedLayout, "SliceSink (Columns)", text + other );
+
+#ifdef TEXTFLOW_CONFIG_ENABLE_COROUTINES
+        std::string generated;
+        bool first = true;
+        for( auto const& generatedLine : TextFlow::generateLines( layout ) ) {
+            if( !first )
+                generated += '\n';
+            first = false;
+            generated += generatedLine;
+        }
+        check( generated == expectedLayout, "generateLines", text + other );
+#endif
+    }
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput( uint8_t const* data, size_t size ) {
+    fuzz( data, size );
+    return 0;
+}
+
+#ifdef TEXTFLOW_FUZZ_STANDALONE
+#include <random>
+
+int main( int argc, char** argv ) {
+    if( argc > 1 ) {
+        for( int i = 1; i < argc; ++i ) {
+            auto file = std::fopen( argv[i], "rb" );
+            if( !file ) {
+                std::fprintf( stderr, "Can't open %s\n", argv[i] );
+                return 1;
+            }
+            std::string input;
+            char buffer[4096];
+            while( auto read = std::fread( buffer, 1, sizeof( buffer ), file ) )
+                input.append( buffer, read );
+            std::fclose( file );
+            fuzz( reinterpret_cast<uint8_t const*>( input.data() ), input.size() );
+        }
+        return 0;
+    }
+
+    // Text made mostly of the characters wrapping cares about
+    static char const chars[] = "    \t\n\rabcdefgxyz(),.;-[]<>|/&=+*{}\\";
+    std::mt19937 rng( 1 );
+    for( int run = 0; run < 20000; ++run ) {
+        std::string input( 5 + rng() % 300, ' ' );
+        for( size_t i = 0; i < input.size(); ++i )
+            input[i] = i < 5 ? static_cast<char>( rng() ) : chars[rng() % ( sizeof( chars ) - 1 )];
+        fuzz( reinterpret_cast<uint8_t const*>( input.data() ), input.size() );
+    }
+    std::printf( "All inputs matched the reference\n" );
+    return 0;
+}
+#endif
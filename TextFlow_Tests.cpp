@@ -1,4 +1,14 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iterator>
 #include <random>
+#include <sstream>
+#include <thread>
 #include "TextFlow.hpp"
 
 #include "catch.hpp"
@@ -242,8 +252,514 @@ TEST_CASE( "combined columns" ) {
            "              be blanks on\n"
            "              the left" );
 
+    std::ostringstream oss;
+    oss << layout;
+    CHECK( oss.str() == layout.toString() );
 }
 
+TEST_CASE( "spacers" ) {
+    auto a = Column( "one two" ).width( 4 );
+    auto b = Column( "three" ).width( 6 );
+
+    CHECK( ( Spacer( 2 ) + a + Spacer( 1 ) + Spacer( 2 ) + b + Spacer( 5 ) ).toString() ==
+            "  one    three\n"
+            "  two" );
+
+    Columns layout;
+    layout += Spacer( 3 );
+    layout += b;
+    CHECK( layout.toString() == "   three" );
+    CHECK( ( Columns() + Spacer( 4 ) ).toString() == "" );
+    CHECK( ( Spacer( 1 ) + Spacer( 2 ) + b ).toString() == "   three" );
+
+    // Spacers keep their width when the columns are fitted around them
+    auto fitted = a + Spacer( 10 ) + b;
+    fitted.fitWidths( 30 );
+    auto lines = toVector( fitted );
+    REQUIRE( lines.size() == 1 );
+    CHECK( lines[0].find( "three" ) >= 8 + 10 );
+    CHECK( lines[0].size() <= 30 );
+}
+
+TEST_CASE( "columns iterator" ) {
+    // More columns than the iterator holds inline
+    Columns layout;
+    for( int i = 0; i < 10; ++i )
+        layout += Column( std::string( static_cast<size_t>( i ), 'x' ) + " y" ).width(3);
+
+    auto it = layout.begin();
+    auto itEnd = layout.end();
+    CHECK( it == layout.begin() );
+    CHECK( *it == " y x yxx xxxxx-xx-xx-xx-xx-xx-" );
+    CHECK( *++it == "      y  y  xx xxxxx-xx-xx-xx-" );
+    CHECK( it != layout.begin() );
+    CHECK( it != itEnd );
+
+    CHECK( std::distance( layout.begin(), itEnd ) == 5 );
+    auto last = layout.begin();
+    std::advance( last, 5 );
+    CHECK( last == itEnd );
+}
+
+TEST_CASE( "wrapping by column" ) {
+    auto layout = Column( "This is a load of text that should go on the left" ).width(10)
+                  + Spacer(4)
+                  + Column( "\x1b[1mHere's some more\x1b[0m strings that should be formatted to the right" ).width(12).ansi()
+                  + Column( "\tshort" ).width(8).tabWidth(4).initialIndent(1).indent(2);
+
+    CHECK( layout.toStringByColumn() == layout.toString() );
+#ifdef TEXTFLOW_CONFIG_ENABLE_THREADS
+    CHECK( layout.toStringByColumn( 3 ) == layout.toString() );
+    CHECK( layout.toStringByColumn( 16 ) == layout.toString() );
+#endif
+    CHECK( Columns().toStringByColumn() == "" );
+}
+
+TEST_CASE( "fixed width columns" ) {
+    auto text = std::string( "This text has\n  newlines\nembedded in it - but also some long text that should be wrapped, abcdefghijklmnopqrstuvwxyz" );
+    auto fixed = FixedColumn<20, 2>( text );
+
+    CHECK( fixed.width() == 20 );
+    CHECK( fixed.toString() == Column( text ).width( 20 ).indent( 2 ).toString() );
+    CHECK( FixedColumn<12, 4, 0>( text ).toString() == Column( text ).width( 12 ).indent( 4 ).initialIndent( 0 ).toString() );
+    CHECK( FixedColumn<12>( "\ttabbed\ttext" ).tabWidth( 4 ).toString() == Column( "\ttabbed\ttext" ).width( 12 ).tabWidth( 4 ).toString() );
+    CHECK( FixedColumn<80>( "" ).toString() == "" );
+
+    std::vector<std::string> lines;
+    std::copy( fixed.begin(), fixed.end(), std::back_inserter( lines ) );
+    CHECK( lines == toVector( Column( text ).width( 20 ).indent( 2 ) ) );
+    CHECK( fixed.height( 20 ) == lines.size() );
+
+    auto layout = fixed.column() + Spacer( 2 ) + FixedColumn<10>( text ).column();
+    CHECK( layout.toString() == ( Column( text ).width( 20 ).indent( 2 ) + Spacer( 2 ) + Column( text ).width( 10 ) ).toString() );
+}
+
+TEST_CASE( "line break index" ) {
+    auto col = Column( "It is a period of civil war.\n"
+                       "Rebel spaceships, striking from a hidden base, have won their first victory against the evil Galactic Empire." )
+        .initialIndent( 2 )
+        .indent( 1 );
+    LineBreakIndex index( col );
+
+    for( size_t width = 4; width < 120; ++width ) {
+        CAPTURE( width );
+        CHECK( index.height( width ) == toVector( col.width( width ) ).size() );
+    }
+    CHECK( LineBreakIndex( Column( "" ) ).height( 10 ) == 0 );
+    CHECK( LineBreakIndex( Column( "a\tb\tc" ).tabWidth( 4 ) ).height( 6 ) == 2 );
+}
+
+TEST_CASE( "measuring columns" ) {
+    auto col = Column( "It is a period of civil war.\n"
+                       "Rebel spaceships, striking from a hidden base, have won their first victory against the evil Galactic Empire." )
+        .indent( 2 );
+
+    CHECK( col.height( 20 ) == toVector( Column( col ).width( 20 ) ).size() );
+    CHECK( col.maxLineWidth( 20 ) == 19 ); // "  striking from a"
+    CHECK( col.maxLineWidth( 200 ) == 2 + 109 );
+
+    // "spaceships," is the longest word
+    CHECK( col.minWidth() == 2 + 11 );
+    CHECK( Column( col ).width( 13 ).toString().find( "-\n" ) == std::string::npos );
+    CHECK( Column( col ).width( 12 ).toString().find( "-\n" ) != std::string::npos );
+
+    CHECK( col.widthFor( 2 ) == 2 + 109 );
+    auto width = col.widthFor( 5 );
+    CHECK( col.height( width ) <= 5 );
+    CHECK( col.height( width-1 ) > 5 );
+    CHECK( col.widthFor( 1 ) == std::string::npos ); // there are two paragraphs
+
+    auto tabbed = Column( "a\tbcd e" ).tabWidth( 4 );
+    CHECK( tabbed.maxLineWidth( 20 ) == 9 );
+    CHECK( tabbed.minWidth() == 3 );
+}
+
+TEST_CASE( "laying out at several widths" ) {
+    auto col = Column( "It is a period of civil war.\n"
+                       "Rebel spaceships, striking from a hidden base, have won their first victory against the evil Galactic Empire." )
+        .initialIndent( 2 )
+        .indent( 1 )
+        .align( Alignment::Right );
+    MultiWidthLayout layouts( col, { 20, 80, 160, 7 } );
+
+    REQUIRE( layouts.size() == 4 );
+    for( size_t i = 0; i < layouts.size(); ++i ) {
+        auto width = layouts.width( i );
+        CAPTURE( width );
+        CHECK( layouts.toString( i ) == Column( col ).width( width ).toString() );
+        CHECK( layouts.height( i ) == toVector( Column( col ).width( width ) ).size() );
+    }
+
+    auto tabbed = Column( "a\tb\tc d\te" ).tabWidth( 4 );
+    MultiWidthLayout tabbedLayouts( tabbed, { 6, 10 } );
+    CHECK( tabbedLayouts.toString( 0 ) == Column( tabbed ).width( 6 ).toString() );
+    CHECK( tabbedLayouts.toString( 1 ) == Column( tabbed ).width( 10 ).toString() );
+}
+
+#ifdef TEXTFLOW_CONFIG_ENABLE_THREADS
+TEST_CASE( "sharing columns between threads", "[threads]" ) {
+    std::string text;
+    for( int i = 0; i < 50; ++i )
+        text += "It is a period of civil war. Rebel spaceships, striking from a hidden base,\n"
+                "have won their first victory against the evil (Galactic) Empire. ";
+    auto const col = Column( text ).indent( 2 ).initialIndent( 0 );
+    auto const layout = Column( text ).width( 30 ) + Spacer( 2 ) + Column( text ).width( 40 ).indent( 1 );
+
+    // Worked out from copies, so the shared columns' indices are still to be built by the threads
+    std::vector<std::string> expected;
+    for( size_t width = 10; width < 74; ++width )
+        expected.push_back( Column( col ).width( width ).toString() );
+    auto expectedLayout = Columns( layout ).toString();
+
+    std::atomic<int> mismatches{ 0 };
+    std::vector<std::thread> threads;
+    for( size_t t = 0; t < 64; ++t ) {
+        threads.emplace_back( [&, t] {
+            auto width = 10 + t;
+            std::string out;
+            size_t lines = 0;
+            for( auto it = col.begin( width ); it != col.end(); ++it, ++lines ) {
+                if( lines > 0 )
+                    out += '\n';
+                out += *it;
+            }
+            if( out != expected[t] || LineBreakIndex( col ).height( width ) != lines )
+                ++mismatches;
+            if( layout.toString() != expectedLayout )
+                ++mismatches;
+        } );
+    }
+    for( auto& thread : threads )
+        thread.join();
+    CHECK( mismatches == 0 );
+}
+
+TEST_CASE( "wrapping one long paragraph in parallel", "[threads]" ) {
+    // A single paragraph, long enough to be split between threads
+    std::string text;
+    for( int i = 0; i < 5000; ++i )
+        text += "Rebel spaceships, striking from a hidden (base), have won their first victory-against-the-evil Galactic Empire. ";
+
+    for( size_t width : { 7, 20, 80 } ) {
+        CAPTURE( width );
+        auto col = Column( text ).width( width ).indent( 2 ).initialIndent( 0 );
+        auto expected = col.toString();
+        CHECK( col.toString( 4 ) == expected );
+        CHECK( col.toString( 1 ) == expected );
+        col.tabWidth( 4 ).align( Alignment::Justify );
+        CHECK( col.toString( 3 ) == col.toString() );
+    }
+
+    // There's nowhere for a guessed line to get back in step, so the seams are wrapped in full
+    auto word = Column( std::string( 300000, 'x' ) ).width( 33 );
+    CHECK( word.toString( 4 ) == word.toString() );
+    auto spaces = Column( std::string( 300000, ' ' ) );
+    CHECK( spaces.toString( 4 ) == spaces.toString() );
+    auto newlineFirst = Column( "\n" + text );
+    CHECK( newlineFirst.toString( 4 ) == newlineFirst.toString() );
+}
+#endif
+
+TEST_CASE( "fitting column widths" ) {
+    auto a = Column( "This is a load of text that should go on the left" );
+    auto b = Column( "Here's some more strings that should be formatted to the right. "
+                     "It's longer so there should be blanks on the left" ).indent( 2 );
+
+    auto layout = a + Spacer(4) + b;
+    layout.fitWidths( 40 );
+    auto rows = toVector( layout ).size();
+
+    // Check against every way of splitting the width
+    size_t fewestRows = std::string::npos;
+    for( size_t width = 2; width <= 32; ++width ) {
+        auto heightA = toVector( Column( a ).width( width ) ).size();
+        auto heightB = toVector( Column( b ).width( 36 - width ) ).size();
+        fewestRows = (std::min)( fewestRows, (std::max)( heightA, heightB ) );
+    }
+    CHECK( rows == fewestRows );
+    for( auto const& line : toVector( layout ) )
+        CHECK( line.size() <= 40 );
+
+    SECTION( "with limits" ) {
+        layout.fitWidths( 40, { { 20, 30 }, { 4, 40 } } );
+        auto lines = toVector( layout );
+        CHECK( lines.size() == 9 );
+        CHECK( lines[0] == "This is a load of         Here's some" );
+    }
+    SECTION( "with limits narrower than the indent" ) {
+        // b is indented by 2, so can't be narrower than 4
+        layout.fitWidths( 40, { { 1, 30 }, { 0, 2 } } );
+        auto lines = toVector( layout );
+        CHECK( lines.size() == toVector( Column( b ).width( 4 ) ).size() );
+        CHECK( lines[0] == "This is a load of text that         H-" );
+    }
+}
+
+TEST_CASE( "streaming input" ) {
+    auto text = std::string(
+        "\nIt is a period of civil war. Rebel spaceships, striking from a hidden base, have won their first victory "
+        "against the evil Galactic Empire.\n\n"
+        "During the battle, \x1b[31mRebel spies\x1b[0m managed to steal secret plans to the Empire's ultimate weapon,\t"
+        "the DEATH STAR, an armored space station with enough power to destroy an entire planet.       \n"
+        "(unbreakable-unbreakable-unbreakable)" );
+
+    for( size_t chunkSize : { 1, 3, 16, 1000 } ) {
+        for( size_t width : { 6, 20, 79 } ) {
+            CAPTURE( chunkSize );
+            CAPTURE( width );
+            std::istringstream iss( text );
+            StreamColumn stream( iss, chunkSize );
+            stream.width( width ).initialIndent( 1 ).indent( 2 ).ansi().tabWidth( 4 );
+            std::ostringstream oss;
+            oss << stream;
+
+            CHECK( oss.str() == Column( text ).width( width ).initialIndent( 1 ).indent( 2 ).ansi().tabWidth( 4 ).toString() );
+        }
+    }
+
+    SECTION( "from a chunk reader" ) {
+        size_t calls = 0;
+        StreamColumn stream( [&]( char* buffer, size_t ) -> size_t {
+            if( calls++ == 3 )
+                return 0;
+            std::copy_n( "one two ", 8, buffer );
+            return 8;
+        }, 8 );
+        stream.width( 8 );
+
+        std::string line;
+        std::vector<std::string> lines;
+        while( stream.nextLine( line ) )
+            lines.push_back( line );
+        CHECK( lines == std::vector<std::string>{ "one two", "one two", "one two" } );
+        CHECK_FALSE( stream.nextLine( line ) );
+    }
+    SECTION( "empty" ) {
+        std::istringstream iss( "" );
+        StreamColumn stream( iss );
+        std::string line;
+        CHECK_FALSE( stream.nextLine( line ) );
+    }
+}
+
+#ifdef TEXTFLOW_CONFIG_ENABLE_POSIX_IO
+TEST_CASE( "memory mapped files" ) {
+    auto text = std::string( "The quick brown fox jumped over the lazy dog\n" ) + std::string( 10000, 'z' );
+    auto path = std::string( "textflow_mapped_file_test.txt" );
+    {
+        std::ofstream out( path, std::ios::binary );
+        out << text;
+    }
+    {
+        MappedFile file( path );
+        CHECK( file.text().size() == text.size() );
+        CHECK( Column( file.text() ).width( 20 ).toString() == Column( text ).width( 20 ).toString() );
+    }
+    {
+        std::ofstream out( path, std::ios::binary | std::ios::trunc );
+    }
+    CHECK( Column( MappedFile( path ).text() ).toString() == "" );
+    std::remove( path.c_str() );
+
+    CHECK_THROWS_AS( MappedFile( "no/such/file" ), std::system_error const& );
+}
+#endif
+
+auto readAll( std::FILE* file ) -> std::string {
+    std::fflush( file );
+    std::rewind( file );
+    std::string text;
+    char buffer[256];
+    while( auto read = std::fread( buffer, 1, sizeof(buffer), file ) )
+        text.append( buffer, read );
+    return text;
+}
+
+TEST_CASE( "output sinks" ) {
+    auto col = Column( "The quick brown \x1b[33mfox\x1b[0m jumped over the lazy dog. " + std::string( 300, 'x' ) ).width( 12 ).indent( 2 );
+    auto layout = Column( "This is a load of text that should go on the left" ).width( 10 )
+                  + Spacer( 300 )
+                  + Column( "Here's\tsome more strings that should be formatted to the right" ).width( 12 ).tabWidth( 4 )
+                  + Column( "\x1b[1mbold\x1b[0m" ).width( 6 ).ansi();
+    auto expected = col.toString() + "\n" + layout.toString() + "\n";
+
+    SECTION( "FILE*" ) {
+        auto file = std::tmpfile();
+        REQUIRE( file );
+        FileSink( file ).write( col ).write( "\n" ).write( layout ).write( "\n" );
+        CHECK( readAll( file ) == expected );
+        std::fclose( file );
+    }
+#ifdef TEXTFLOW_CONFIG_ENABLE_POSIX_IO
+    SECTION( "file descriptor" ) {
+        auto file = std::tmpfile();
+        REQUIRE( file );
+        FdSink sink( fileno( file ) );
+        sink.write( col ).write( "\n" ).write( layout ).write( "\n" );
+
+        // Enough lines that they have to go out over more than one writev() call
+        auto longText = std::string();
+        for( int i = 0; i < 3000; ++i )
+            longText += "word" + std::to_string( i ) + " ";
+        sink.write( Column( longText ).width( 10 ).indent( 1 ) );
+        CHECK( readAll( file ) == expected + Column( longText ).width( 10 ).indent( 1 ).toString() );
+        std::fclose( file );
+    }
+#endif
+}
+
+TEST_CASE( "compacting output" ) {
+    auto layout = Column( "one two three\nfour  \nfive" ).width( 20 ) + Spacer( 10 ) + Column( "a b c" ).width( 2 ) + Column( "x" ).width( 3 );
+
+    CHECK( layout.toString() ==
+            "one two three                 a x\n"
+            "four                          b\n"
+            "five                          c" );
+
+    layout.compact( Compaction::TrimTrailing );
+    CHECK( layout.toString() ==
+            "one two three                 a x\n"
+            "four                          b\n"
+            "five                          c" );
+    CHECK( ( Columns() + Column( "trailing \nspace  \t" ).width( 20 ) ).compact( Compaction::TrimTrailing ).toString() == "trailing\nspace" );
+
+    layout.compact( Compaction::CursorForward );
+    CHECK( layout.toString() ==
+            "one two three\x1b[17Ca x\n"
+            "four\x1b[26Cb\n"
+            "five\x1b[26Cc" );
+    // Short runs are cheaper as spaces
+    CHECK( ( Column( "ab" ).width( 5 ) + Column( "c" ).width( 2 ) ).compact( Compaction::CursorForward ).toString() == "ab   c" );
+    // Blank runs within a column too, joined with any padding before them
+    CHECK( ( Columns() + Column( "right" ).width( 20 ).align( Alignment::Right ) ).compact( Compaction::CursorForward ).toString() == "\x1b[15Cright" );
+    CHECK( ( Column( "a" ).width( 3 ) + Column( "b" ).width( 10 ).indent( 6 ) ).compact( Compaction::CursorForward ).toString() == "a\x1b[8Cb" );
+    CHECK( ( Columns() + Column( "x\ty     z" ).width( 20 ).tabWidth( 10 ) ).compact( Compaction::CursorForward ).toString() == "x\x1b[9Cy\x1b[5Cz" );
+    CHECK( ( Columns() + Column( "alpha beta gamma" ).width( 14 ).align( Alignment::Justify ) ).compact( Compaction::CursorForward ).toString() == "alpha\x1b[5Cbeta\ngamma" );
+    // except within ANSI text, where they may be coloured
+    CHECK( ( Columns() + Column( "\x1b[41ma      b\x1b[0m" ).width( 20 ).ansi() ).compact( Compaction::CursorForward ).toString() == "\x1b[41ma      b\x1b[0m" );
+
+    auto file = std::tmpfile();
+    FileSink( file ).write( layout );
+    CHECK( readAll( file ) == layout.toString() );
+    std::fclose( file );
+}
+
+TEST_CASE( "redrawing changed rows" ) {
+    auto status = []( std::string const& cpu ) {
+        return Column( "Name\nCPU\nMemory" ).width( 8 ) + Column( "web\n" + cpu + "\n1GB" ).width( 4 );
+    };
+    DiffRenderer renderer( 3 );
+
+    CHECK( renderer.render( status( "10%" ) ) ==
+            "\x1b[3;1HName    web\x1b[K"
+            "\x1b[4;1HCPU     10%\x1b[K"
+            "\x1b[5;1HMemory  1GB\x1b[K" );
+    CHECK( renderer.render( status( "10%" ) ).empty() );
+    CHECK( renderer.render( status( "99%" ) ) == "\x1b[4;1HCPU     99%\x1b[K" );
+
+    // A row is drawn again if anything that affects it changes, not just its text
+    CHECK( renderer.render( status( "99%" ).compact( Compaction::TrimTrailing ) ) ==
+            "\x1b[3;1HName    web\x1b[K"
+            "\x1b[4;1HCPU     99%\x1b[K"
+            "\x1b[5;1HMemory  1GB\x1b[K" );
+
+    CHECK( renderer.render( Columns() + Column( "Name" ).width( 8 ) ) ==
+            "\x1b[3;1HName\x1b[K"
+            "\x1b[4;1H\x1b[K"
+            "\x1b[5;1H\x1b[K" );
+
+    renderer.invalidate();
+    CHECK( renderer.render( Columns() + Column( "Name" ).width( 8 ) ) == "\x1b[3;1HName\x1b[K" );
+
+    // Blanks overwrite what was there before, rather than being skipped over with cursor movements
+    DiffRenderer overwriting;
+    overwriting.render( Column( "ABCDEFGHIJ" ).width( 11 ) + Column( "x" ).width( 2 ) );
+    CHECK( overwriting.render( ( Column( "AB" ).width( 11 ) + Column( "y" ).width( 2 ) ).compact( Compaction::CursorForward ) ) ==
+            "\x1b[1;1HAB         y\x1b[K" );
+}
+
+#ifdef TEXTFLOW_CONFIG_ENABLE_COROUTINES
+TEST_CASE( "coroutines" ) {
+    auto col = Column( "The quick brown fox jumped over the lazy dog" ).width( 10 );
+
+    SECTION( "generating lines" ) {
+        std::vector<std::string> lines;
+        for( auto& line : generateLines( col ) )
+            lines.push_back( line );
+        CHECK( lines == toVector( col ) );
+
+        auto layout = col + Spacer( 2 ) + Column( "a b c d e f g" ).width( 2 );
+        lines.clear();
+        for( auto& line : generateLines( layout ) )
+            lines.push_back( line );
+        CHECK( lines == toVector( layout ) );
+    }
+
+    // Produces text a word at a time, as if it were being decoded
+    auto words = []( int count ) -> Generator<std::string> {
+        for( int i = 0; i < count; ++i )
+            co_yield "word" + std::to_string( i ) + ( i % 7 == 6 ? "\n" : " " );
+    };
+    std::string text;
+    for( auto& word : words( 500 ) )
+        text += word;
+    auto expected = toVector( Column( text ).width( 17 ).indent( 1 ) );
+
+    SECTION( "wrapping text from a generator" ) {
+        auto chunks = words( 500 );
+        StreamColumn stream( readChunksFrom( chunks ), 5 );
+        stream.width( 17 ).indent( 1 );
+
+        std::vector<std::string> lines;
+        for( auto& line : generateLines( stream ) )
+            lines.push_back( line );
+        CHECK( lines == expected );
+    }
+#ifdef TEXTFLOW_CONFIG_ENABLE_THREADS
+    SECTION( "on separate threads" ) {
+        auto chunks = runAhead( words( 500 ), 4 );
+        StreamColumn stream( readChunksFrom( chunks ), 5 );
+        stream.width( 17 ).indent( 1 );
+
+        std::vector<std::string> lines;
+        for( auto& line : runAhead( generateLines( stream ), 3 ) )
+            lines.push_back( line );
+        CHECK( lines == expected );
+    }
+    SECTION( "stopping early" ) {
+        auto chunks = runAhead( words( 500 ), 4 );
+        for( auto& chunk : chunks ) {
+            CHECK( chunk == "word0 " );
+            break;
+        }
+    }
+#endif
+}
+#endif
+
+#if defined( __cpp_nontype_template_args ) && __cpp_nontype_template_args >= 201911L
+TEST_CASE( "wrapping literals at compile time" ) {
+    constexpr auto help = wrapLiteral<"This text has\n  newlines\nembedded in it - but also some long text that should be wrapped", 20, 2>();
+    static_assert( help.size() == 100 );
+    CHECK( help.str() ==
+            "  This text has\n"
+            "    newlines\n"
+            "  embedded in it -\n"
+            "  but also some long\n"
+            "  text that should\n"
+            "  be wrapped" );
+
+    constexpr auto hyphenated = wrapLiteral<"abcdefghijklmnopqrstuvwxyz and more", 10, 2, 0>();
+    CHECK( hyphenated.str() == Column( "abcdefghijklmnopqrstuvwxyz and more" ).width( 10 ).indent( 2 ).initialIndent( 0 ).toString() );
+
+    constexpr auto leadingNewline = wrapLiteral<"\nthis is a message starting with linebreak", 79, 2>();
+    CHECK( leadingNewline.str() == "  \nthis is a message starting with linebreak" );
+
+    CHECK( wrapLiteral<"">().str() == "" );
+    CHECK( std::string( wrapLiteral<"one two three", 6>().c_str() ) == "one\ntwo\nthree" );
+}
+#endif
+
 TEST_CASE( "indent at existing newlines" ) {
     auto col = Column( "This text has\n  newlines\nembedded in it - but also some long text that should be wrapped" )
         .width(20)
@@ -295,6 +811,245 @@ TEST_CASE( "message with linebreak at start" )
     );
 }
 
+TEST_CASE( "ansi escape sequences" ) {
+
+    SECTION( "are zero width and carried across wrapped lines" ) {
+        auto col = Column( "\x1b[1;32mThe quick brown\x1b[0m fox" ).width(10).ansi();
+
+        CHECK( toVector( col ) == std::vector<std::string>{
+                   "\x1b[1;32mThe quick\x1b[0m",
+                   "\x1b[1;32mbrown\x1b[0m fox" } );
+    }
+    SECTION( "are never split" ) {
+        auto col = Column( "aaaa \x1b[31mbbbb\x1b[0m cccc" ).width(10).ansi();
+        CHECK( col.toString() == "aaaa \x1b[31mbbbb\x1b[0m\ncccc" );
+    }
+    SECTION( "are reset before padding" ) {
+        auto layout = Column( "\x1b[7mone two\x1b[0m" ).width(5).ansi() + Column( "a b c" ).width(2);
+        CHECK( layout.toString() ==
+               "\x1b[7mone\x1b[0m  a\n"
+               "\x1b[7mtwo\x1b[0m  b\n"
+               "     c" );
+    }
+    SECTION( "osc sequences" ) {
+        auto col = Column( "\x1b]8;;http://x.y\x1b\\link\x1b]8;;\x1b\\ text" ).width(6).ansi();
+        CHECK( col.toString() == "\x1b]8;;http://x.y\x1b\\link\x1b]8;;\x1b\\\ntext" );
+    }
+    SECTION( "later codes replace earlier ones" ) {
+        std::string text;
+        for( int i = 0; i < 200; ++i )
+            text += "\x1b[31mred\x1b[39m word ";
+        auto col = Column( text ).width(20).ansi();
+        for( auto const& line : col )
+            CHECK( line.size() < 60 );
+
+        CHECK( Column( "\x1b[1m\x1b[31m\x1b[22;44mone two" ).width(4).ansi().toString() ==
+               "\x1b[1m\x1b[31m\x1b[22;44mone\x1b[0m\n"
+               "\x1b[31;44mtwo\x1b[0m" );
+        CHECK( Column( "\x1b[38;5;196;1mone\x1b[1;0m two" ).width(4).ansi().toString() ==
+               "\x1b[38;5;196;1mone\x1b[1;0m\ntwo" );
+    }
+    SECTION( "extended colours and sub-parameters are carried across" ) {
+        CHECK( Column( "\x1b[48;2;10;20;30m\x1b[38:5:208m\x1b[4:3mone two" ).width(4).ansi().toString() ==
+               "\x1b[48;2;10;20;30m\x1b[38:5:208m\x1b[4:3mone\x1b[0m\n"
+               "\x1b[4:3;38;5;208;48;2;10;20;30mtwo\x1b[0m" );
+        CHECK( Column( "\x1b[4;31mone\x1b[4:0;49m two" ).width(4).ansi().toString() ==
+               "\x1b[4;31mone\x1b[4:0;49m\x1b[0m\n"
+               "\x1b[31mtwo\x1b[0m" );
+        // The state is plain data, so copying iterators doesn't allocate
+        CHECK( std::is_trivially_copyable<TextFlow::SgrState>::value );
+    }
+    SECTION( "a large text" ) {
+        // Each line only looks for escape sequences in its own text, so this doesn't take quadratic time
+        std::string text, plain;
+        while( text.size() < 4000000 ) {
+            text += "The quick brown \x1b[33mfox\x1b[0m jumps over the lazy dog. ";
+            plain += "The quick brown fox jumps over the lazy dog. ";
+        }
+        auto wrapped = Column( text ).width( 80 ).ansi().toString();
+        std::string visible;
+        for( size_t at = 0; at < wrapped.size(); ++at ) {
+            if( auto len = TextFlow::escapeSequenceLength( wrapped, at ) )
+                at += len-1;
+            else
+                visible += wrapped[at];
+        }
+        CHECK( visible == Column( plain ).width( 80 ).toString() );
+    }
+}
+
+TEST_CASE( "tab expansion" ) {
+    auto col = Column( "a\tbb\tccc\tdddd eeeee\tf" ).tabWidth(4);
+
+    SECTION( "tab stops are counted from the indent" ) {
+        col.width(40).indent(2);
+        CHECK( col.toString() == "  a   bb  ccc dddd eeeee  f" );
+    }
+    SECTION( "tabs count towards the width" ) {
+        col.width(12);
+        CHECK( col.toString() == "a   bb  ccc\ndddd eeeee\nf" );
+    }
+    SECTION( "unexpanded by default" ) {
+        CHECK( Column( "a\tb" ).toString() == "a\tb" );
+    }
+    SECTION( "wider than the width" ) {
+        // Clamped to fill a line of its own
+        CHECK( Column( "\tabc def" ).width(6).tabWidth(8).toString() == "     \nabc\ndef" );
+        CHECK( Column( "abc\n\tdef" ).width(6).tabWidth(8).toString() == "abc\n     \ndef" );
+        CHECK( Column( "\tabc" ).width(8).tabWidth(8).toString() == "       \nabc" );
+        CHECK( Column( "\tabc" ).width(6).tabWidth(8).height(6) == 2 );
+    }
+}
+
+TEST_CASE( "hyphenation" ) {
+    // The patterns from Liang's thesis that hyphenate "hyphenation"
+    auto patterns = std::string( "% a comment\nhy3ph he2n hena4 hen5at 1na n2at 1tio 2io o2n\n" );
+    Hyphenator hyphenator( patterns );
+
+    CHECK( hyphenator.breaks( std::string( "Hyphenation" ) ) == std::vector<size_t>{ 2, 6 } );
+    CHECK( hyphenator.breaks( std::string( "hyphenation" ) ) == std::vector<size_t>{ 2, 6 } ); // cached
+    CHECK( hyphenator.breaks( std::string( "nation" ) ) == std::vector<size_t>{ 2 } );
+    CHECK( hyphenator.breaks( std::string( "hyph" ) ).empty() ); // too short
+
+    auto text = std::string( "The (hyphenation) of words" );
+    CHECK( Column( text ).width( 7 ).hyphenate( hyphenator ).toString() == "The\n(hy-\nphen-\nation)\nof\nwords" );
+    CHECK( Column( text ).width( 7 ).toString() == "The\n(hyphe-\nnation)\nof\nwords" );
+    // No legal break fits in what's left of the word, so it's split as before
+    CHECK( Column( text ).width( 5 ).hyphenate( hyphenator ).toString() == "The\n(hy-\nphen-\natio-\nn) of\nwords" );
+
+    // As in TeX, words longer than 63 letters aren't hyphenated
+    auto longest = std::string( "hyphenationhyphenationhyphenationhyphenationhyphenationhyphenat" );
+    CHECK( longest.size() == 63 );
+    CHECK_FALSE( hyphenator.breaks( longest ).empty() );
+    CHECK( Column( longest ).width( 20 ).hyphenate( hyphenator ).toString() != Column( longest ).width( 20 ).toString() );
+    auto tooLong = longest + "i";
+    CHECK( hyphenator.breaks( tooLong ).empty() );
+    CHECK( Column( tooLong ).width( 20 ).hyphenate( hyphenator ).toString() == Column( tooLong ).width( 20 ).toString() );
+
+    auto col = Column( text ).hyphenate( hyphenator );
+    LineBreakIndex index( col );
+    for( size_t width = 3; width < 30; ++width )
+        CHECK( index.height( width ) == toVector( col.width( width ) ).size() );
+
+    auto path = std::string( "textflow_hyphenation_test.pat.txt" );
+    {
+        std::ofstream out( path, std::ios::binary );
+        out << patterns;
+    }
+    CHECK( Hyphenator::fromFile( path ).breaks( std::string( "hyphenation" ) ) == std::vector<size_t>{ 2, 6 } );
+    std::remove( path.c_str() );
+
+    CHECK_THROWS_AS( Hyphenator::fromFile( "no/such/file" ), std::system_error const& );
+}
+
+TEST_CASE( "alignment" ) {
+    auto text = std::string( "It is a period of civil war. Rebel spaceships, striking from a hidden base,\nhave won their first victory." );
+
+    SECTION( "right" ) {
+        CHECK( Column( text ).width( 24 ).indent( 2 ).align( Alignment::Right ).toString() ==
+                "       It is a period of\n"
+                "        civil war. Rebel\n"
+                "    spaceships, striking\n"
+                "     from a hidden base,\n"
+                "    have won their first\n"
+                "                victory." );
+    }
+    SECTION( "centre" ) {
+        CHECK( Column( text ).width( 24 ).indent( 2 ).align( Alignment::Centre ).toString() ==
+                "    It is a period of\n"
+                "     civil war. Rebel\n"
+                "   spaceships, striking\n"
+                "   from a hidden base,\n"
+                "   have won their first\n"
+                "         victory." );
+    }
+    SECTION( "justified" ) {
+        // The last line of each paragraph is left as it is
+        CHECK( Column( text ).width( 24 ).indent( 2 ).align( Alignment::Justify ).toString() ==
+                "  It   is  a  period  of\n"
+                "  civil    war.    Rebel\n"
+                "  spaceships,   striking\n"
+                "  from a hidden base,\n"
+                "  have  won  their first\n"
+                "  victory." );
+        CHECK( Column( "\x1b[31mred words\x1b[0m here and there again" ).ansi().width( 12 ).align( Alignment::Justify ).toString() ==
+                "\x1b[31mred    words\x1b[0m\n"
+                "here     and\n"
+                "there again" );
+    }
+    SECTION( "in columns" ) {
+        auto layout = Column( "1\n22\n333" ).width( 5 ).align( Alignment::Right ) + Spacer( 1 ) + Column( text ).width( 20 ).align( Alignment::Justify );
+        CHECK( layout.toString() ==
+                "    1 It  is  a  period of\n"
+                "   22 civil   war.   Rebel\n"
+                "  333 spaceships, striking\n"
+                "      from a hidden base,\n"
+                "      have won their first\n"
+                "      victory." );
+        CHECK( layout.toStringByColumn() == layout.toString() );
+    }
+}
+
+TEST_CASE( "mapping offsets to positions" ) {
+    auto text = std::string( "The quick brown fox\njumped over the lazy dog" );
+    auto col = Column( text ).width( 12 ).indent( 2 ).initialIndent( 0 );
+    //  "The quick"
+    //  "  brown fox"
+    //  "  jumped"
+    //  "  over the"
+    //  "  lazy dog"
+    LineMap map( col );
+    REQUIRE( map.lineCount() == 5 );
+
+    CHECK( map.toPosition( 0 ) == TextPosition{ 0, 0 } );
+    CHECK( map.toPosition( text.find( "quick" ) ) == TextPosition{ 0, 4 } );
+    CHECK( map.toPosition( text.find( "brown" ) ) == TextPosition{ 1, 2 } );
+    CHECK( map.toPosition( text.find( "fox" ) ) == TextPosition{ 1, 8 } );
+    CHECK( map.toPosition( text.find( "dog" ) ) == TextPosition{ 4, 7 } );
+    // Whitespace dropped at a wrap goes at the end of the line before
+    CHECK( map.toPosition( text.find( " brown" ) ) == TextPosition{ 0, 9 } );
+    CHECK( map.toPosition( text.find( '\n' ) ) == TextPosition{ 1, 11 } );
+
+    CHECK( map.toOffset( { 1, 8 } ) == text.find( "fox" ) );
+    CHECK( map.toOffset( { 1, 0 } ) == text.find( "brown" ) );
+    CHECK( map.toOffset( { 1, 40 } ) == text.find( '\n' ) );
+    for( size_t offset = 0; offset < text.size(); ++offset ) {
+        if( !isWhitespace( text[offset] ) )
+            CHECK( map.toOffset( map.toPosition( offset ) ) == offset );
+    }
+
+    SECTION( "at another width" ) {
+        LineMap wide( col, 30 );
+        CHECK( wide.lineCount() == 2 );
+        CHECK( wide.toPosition( text.find( "dog" ) ) == TextPosition{ 1, 23 } );
+    }
+    SECTION( "with hyphens" ) {
+        // The hyphen doesn't come from the text, so the next offset is on the next line
+        auto word = Column( "abcdefghij" ).width( 5 );
+        LineMap split( word );
+        CHECK( split.toPosition( 3 ) == TextPosition{ 0, 3 } );
+        CHECK( split.toPosition( 4 ) == TextPosition{ 1, 0 } );
+        CHECK( split.toOffset( { 0, 4 } ) == 4 );
+    }
+    SECTION( "with tabs, escape sequences and alignment" ) {
+        auto styled = std::string( "\x1b[1mab\tc\x1b[0m d" );
+        auto tabs = Column( styled ).ansi().tabWidth( 4 ).width( 20 );
+        LineMap tabbed( tabs );
+        CHECK( tabbed.toPosition( styled.find( 'c' ) ) == TextPosition{ 0, 4 } );
+        CHECK( tabbed.toPosition( styled.find( 'd' ) ) == TextPosition{ 0, 6 } );
+        CHECK( tabbed.toOffset( { 0, 3 } ) == styled.find( '\t' ) );
+
+        auto rightCol = Column( "a b" ).width( 10 ).align( Alignment::Right );
+        LineMap right( rightCol );
+        CHECK( right.toPosition( 2 ) == TextPosition{ 0, 9 } );
+        auto justifiedCol = Column( "a b c d" ).width( 6 ).align( Alignment::Justify );
+        LineMap justified( justifiedCol );
+        //  "a  b c"
+        CHECK( justified.toPosition( 2 ) == TextPosition{ 0, 3 } );
+        CHECK( justified.toOffset( { 0, 2 } ) == 1 );
+    }
+}
+
 std::mt19937 rng;
 std::uniform_int_distribution<std::mt19937::result_type> wordCharGenerator(33,126);
 std::uniform_int_distribution<std::mt19937::result_type> wsGenerator(0, 11);
@@ -315,6 +1070,13 @@ auto generateWord( int length ) -> std::string {
         s += randomWordChar();
     return s;
 }
+// A word of letters only, so that it has nowhere to break
+auto generateLetters( int length ) -> std::string {
+    std::string s;
+    for(; length > 0; --length )
+        s += static_cast<char>( 'a' + wordCharGenerator(rng) % 26 );
+    return s;
+}
 auto generateWord() -> std::string {
     return generateWord( wordLenGenerator(rng) );
 }
@@ -360,3 +1122,104 @@ TEST_CASE( "randomly generated text", "[.]" ) {
     }
     SUCCEED();
 }
+
+// Text of at least `size` bytes, tiled from a pool made by `generate` (so big sizes don't take
+// longer to make than to wrap)
+template<typename Generate>
+auto generateSized( size_t size, Generate generate ) -> std::string {
+    std::string pool;
+    while( pool.size() < (std::min)( size, size_t( 4 ) << 20 ) )
+        pool += generate();
+    std::string text;
+    text.reserve( size + pool.size() );
+    while( text.size() < size )
+        text += pool;
+    return text;
+}
+
+// The slope of log( time ) against log( size ), by least squares: about 1 for linear growth
+auto growthExponent( std::vector<double> const& sizes, std::vector<double> const& times ) -> double {
+    double n = static_cast<double>( sizes.size() ), sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for( size_t i = 0; i < sizes.size(); ++i ) {
+        auto x = std::log( sizes[i] ), y = std::log( times[i] );
+        sx += x;
+        sy += y;
+        sxx += x*x;
+        sxy += x*y;
+    }
+    return ( n*sxy - sx*sy ) / ( n*sxx - sx*sx );
+}
+
+// Wraps text from 1KB to 256MB (64MB for the slower ways of wrapping), of several shapes, at several
+// widths and in each way of wrapping it, and fails if the time taken grows clearly faster than the size.
+// Takes a while (and a GB or so of memory), so is hidden
+TEST_CASE( "wrapping time grows linearly", "[.][scaling]" ) {
+    struct Shape {
+        char const* name;
+        std::function<std::string()> generate;
+    };
+    std::vector<Shape> shapes = {
+        { "prose", [] { return generateText( 100 ); } },
+        { "short lines", [] { return generateText( 8 ) + "\n"; } },
+        { "long words", [] { return generateWord( 150 ) + " "; } },
+        { "no breaks", [] { return generateLetters( 1000 ); } },
+        { "coloured prose", [] { return "\x1b[1;31m" + generateText( 10 ) + "\x1b[22m" + generateText( 10 ) + "\x1b[0m "; } },
+        { "tabbed lines", [] { return generateText( 4 ) + "\t" + generateText( 4 ) + "\n"; } }
+    };
+
+    Hyphenator hyphenator( std::string( "hy3ph he2n hena4 hen5at 1na n2at 1tio 2io o2n a1b c1d e1f" ) );
+    struct Mode {
+        char const* name;
+        size_t maxSize;
+        std::function<std::string( StringRef, size_t )> wrap;
+    };
+    std::vector<Mode> modes = {
+        { "plain", size_t( 256 ) << 20, []( StringRef text, size_t width ) { return Column( text ).width( width ).toString(); } },
+        { "ansi", size_t( 64 ) << 20, []( StringRef text, size_t width ) { return Column( text ).width( width ).ansi().toString(); } },
+        { "tabWidth", size_t( 64 ) << 20, []( StringRef text, size_t width ) { return Column( text ).width( width ).tabWidth( 4 ).toString(); } },
+        { "justified", size_t( 64 ) << 20, []( StringRef text, size_t width ) { return Column( text ).width( width ).align( Alignment::Justify ).toString(); } },
+        { "hyphenated", size_t( 64 ) << 20, [&]( StringRef text, size_t width ) { return Column( text ).width( width ).hyphenate( hyphenator ).toString(); } },
+        { "Columns", size_t( 64 ) << 20, []( StringRef text, size_t width ) {
+            return ( Column( text ).width( width ) + Spacer( 2 ) + Column( text ).width( width/2 + 2 ).indent( 1 ) ).toString();
+        } }
+    };
+
+    for( auto const& mode : modes ) {
+        for( auto const& shape : shapes ) {
+            for( size_t width : { 20, 80, 200 } ) {
+                std::vector<double> sizes, times;
+                for( size_t size = 1024; size <= mode.maxSize; size *= 4 ) {
+                    auto text = generateSized( size, shape.generate );
+
+                    // Repeat small sizes until the time is big enough to measure, and take the best run
+                    double best = 0;
+                    size_t written = 0;
+                    for( int run = 0; run < 3; ++run ) {
+                        size_t repeats = 0;
+                        auto start = std::chrono::steady_clock::now();
+                        std::chrono::duration<double> elapsed{};
+                        do {
+                            written += mode.wrap( text, width ).size();
+                            ++repeats;
+                            elapsed = std::chrono::steady_clock::now() - start;
+                        } while( elapsed.count() < 0.01 );
+                        auto time = elapsed.count() / static_cast<double>( repeats );
+                        best = run == 0 ? time : (std::min)( best, time );
+                    }
+                    REQUIRE( written > 0 );
+                    // Below this, fixed costs hide how the time grows
+                    if( size >= 64*1024 ) {
+                        sizes.push_back( static_cast<double>( text.size() ) );
+                        times.push_back( best );
+                    }
+                }
+                CAPTURE( mode.name );
+                CAPTURE( shape.name );
+                CAPTURE( width );
+                auto exponent = growthExponent( sizes, times );
+                CAPTURE( exponent );
+                CHECK( exponent < 1.25 );
+            }
+        }
+    }
+}